@@ -0,0 +1,179 @@
+#ifndef __COMPONENT_INFO_HEADER__
+#define __COMPONENT_INFO_HEADER__
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/UUID.h"
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <concepts>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <typeindex>
+#include <type_traits>
+#include <unordered_map>
+
+namespace Steve
+{
+	// Small per type index, assigned on first use of a component type
+	using ComponentId = u32;
+	constexpr usize MaxComponentTypes = 64;
+
+	// Bit per ComponentId, set if the entity has that component
+	using Signature = std::bitset<MaxComponentTypes>;
+
+	constexpr u32 InvalidIndex = std::numeric_limits<u32>::max();
+
+	// Old entity id -> new entity id, used when a set of entities gets duplicated
+	using EntityRemap = std::unordered_map<UUID, UUID>;
+
+	// Components that store entity id's can opt in to get them remapped when they are cloned
+	template<typename T>
+	concept RemapsEntities = requires(T& component, const EntityRemap& remap)
+	{
+		component.RemapEntities(remap);
+	};
+
+	// Empty types are tags, they are only stored as a bit in the entity signature
+	template<typename T>
+	concept TagComponent = std::is_empty_v<std::remove_cvref_t<T>>;
+
+	// Deduplicated on content and owned by several entities, see Shared.h
+	template<typename T>
+	concept SharedComponent = requires(const std::remove_cvref_t<T>& component)
+	{
+		typename std::remove_cvref_t<T>::SharedValueType;
+		{ component.Hash() } -> std::convertible_to<u64>;
+		{ component == component } -> std::convertible_to<bool>;
+	};
+
+	// Type erased operations on a component type
+	// One static instance per type, handles only keep a pointer to it
+	struct ComponentTypeInfo
+	{
+		std::type_index Type;
+		ComponentId Index;
+		usize Size;
+		bool TriviallyCopyable;
+		bool Tag;
+
+		// Copy constructs into raw (uninitialized) memory
+		void (*CopyConstruct)(u8* destination, const u8* source);
+		// Move constructs into raw memory, source still has to be destroyed
+		void (*MoveConstruct)(u8* destination, u8* source);
+		// nullptr if the type is trivially destructible
+		void (*Destroy)(u8* component);
+		// nullptr if the type does not implement RemapEntities
+		void (*RemapEntities)(u8* component, const EntityRemap& remap);
+		// nullptr unless the type is a SharedComponent, used to find stored values that are equal
+		u64 (*Hash)(const u8* component);
+		bool (*Equal)(const u8* left, const u8* right);
+	};
+
+	// Moves a component to uninitialized memory and destroys it at its old place
+	// Trivially copyable types are copied bitwise, anything else (like a std::string with a small buffer) is move constructed
+	inline void RelocateComponent(const ComponentTypeInfo& info, u8* destination, u8* source)
+	{
+		if (info.TriviallyCopyable)
+		{
+			memcpy_s(destination, info.Size, source, info.Size);
+			return;
+		}
+
+		info.MoveConstruct(destination, source);
+		if (info.Destroy != nullptr)
+			info.Destroy(source);
+	}
+
+	inline ComponentId NextComponentId()
+	{
+		static std::atomic<ComponentId> next = 0;
+		const ComponentId id = next++;
+		// Fatal in every build, each per type array is MaxComponentTypes long and would be indexed past its end
+		if (id >= MaxComponentTypes)
+		{
+			CORE_ERROR("Too many component types, raise MaxComponentTypes ({})", MaxComponentTypes);
+			std::abort();
+		}
+		return id;
+	}
+
+	// Every ComponentTypeInfo created so far by ComponentId, lets type erased data (like chunk files) find the operations of its types
+	[[nodiscard]] inline std::array<const ComponentTypeInfo*, MaxComponentTypes>& ComponentTypeTable()
+	{
+		static std::array<const ComponentTypeInfo*, MaxComponentTypes> table{};
+		return table;
+	}
+
+	template<typename T>
+	[[nodiscard]] const ComponentTypeInfo& GetComponentTypeInfo()
+	{
+		static_assert(std::is_move_constructible_v<T>, "Components have to be movable");
+
+		static const ComponentTypeInfo info{
+			std::type_index(typeid(T)),
+			NextComponentId(),
+			sizeof(T),
+			std::is_trivially_copyable_v<T>,
+			std::is_empty_v<T>,
+			[](u8* destination, const u8* source)
+			{
+				new(destination) T(*(const T*)source);
+			},
+			[](u8* destination, u8* source)
+			{
+				new(destination) T(std::move(*(T*)source));
+			},
+			[]() -> void (*)(u8*)
+			{
+				if constexpr (std::is_trivially_destructible_v<T>)
+					return nullptr;
+				else
+					return [](u8* component) { ((T*)component)->~T(); };
+			}(),
+			[]() -> void (*)(u8*, const EntityRemap&)
+			{
+				if constexpr (RemapsEntities<T>)
+					return [](u8* component, const EntityRemap& remap) { ((T*)component)->RemapEntities(remap); };
+				else
+					return nullptr;
+			}(),
+			[]() -> u64 (*)(const u8*)
+			{
+				if constexpr (SharedComponent<T>)
+					return [](const u8* component) -> u64 { return ((const T*)component)->Hash(); };
+				else
+					return nullptr;
+			}(),
+			[]() -> bool (*)(const u8*, const u8*)
+			{
+				if constexpr (SharedComponent<T>)
+					return [](const u8* left, const u8* right) -> bool { return *(const T*)left == *(const T*)right; };
+				else
+					return nullptr;
+			}()
+		};
+		static const bool registered = (ComponentTypeTable()[info.Index] = &info, true);
+		(void)registered;
+		return info;
+	}
+
+	template<typename T>
+	[[nodiscard]] ComponentId GetComponentId()
+	{
+		return GetComponentTypeInfo<std::remove_cvref_t<T>>().Index;
+	}
+
+	template<typename ...Ts>
+	[[nodiscard]] Signature MakeSignature()
+	{
+		Signature signature;
+		(void(signature.set(GetComponentId<Ts>())), ...);
+		return signature;
+	}
+}
+
+#endif
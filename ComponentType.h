@@ -15,21 +15,16 @@
 
 namespace Steve
 {
+	// Optional base, any movable type can be a component
+	// Identity is held by the entity, so components carry no vtable or id
 	struct ComponentType 
 	{
-		virtual ~ComponentType() = default;
-		UUID p_Id;
-
-		virtual bool operator==(const ComponentType& x) const
-		{
-			return p_Id == x.p_Id;
-		}
-
 	protected:
 		ComponentType() = default;
 	};
 	
-	struct EmptyComponent : ComponentType{};
+	// Tag, has no data so it only takes a bit in the entity signature
+	struct EmptyComponent {};
 	const std::type_index EmptyComponentType(typeid(EmptyComponent));
 
 
@@ -1,29 +1,44 @@
 #ifndef _CUSTOMSTORAGE_HEADER__
 #define _CUSTOMSTORAGE_HEADER__
 
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
 #include <map>
+#include <memory>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <vector>
 #include <cstdarg>
 
 #include "Steve/Core/UUID.h"
+#include "FlatHashMap.h"
 #include "Handle.h"
 
 namespace Steve
 {
+	// One element of an arena, Info is nullptr for raw bytes that can be copied bitwise
+	struct ArenaElement
+	{
+		u8* Location;
+		usize Size;
+		const ComponentTypeInfo* Info;
+	};
+
 	class ArenaContainer
 	{
 	public:
 		ArenaContainer(size_t initial_size = 1024, float hole_threshold = 0.1f) : mStorageSize(initial_size), mFragThreshold(hole_threshold), mFragHoleSize(0)
 		{
-			mStorage = (u8*)calloc(mStorageSize, 1);
+			mStorageBuffer = AllocateStorage(mStorageSize);
+			mStorage = mStorageBuffer.get();
 			mStorageFreePtr = mStorage;
-			mStorageContent.reserve(mStorageSize);
 		}
 
-		~ArenaContainer()
-		{
-			free(mStorage);
-		}
+		// Storage is released by the last owner, which can be a snapshot
+		~ArenaContainer() = default;
 
 		// Gets ownership of element
 		template<typename T>
@@ -34,22 +49,22 @@ namespace Steve
 				Resize();
 
 			size_t size = sizeof(T);
-			T* ptr = new(mStorageFreePtr) T(element);
+			T* ptr = new(mStorageFreePtr) T(std::forward<T>(element));
 
-			mStorageContent.insert({ uuid, {(u8*)ptr, size } });
+			mStorageContent.insert({ uuid, { (u8*)ptr, size, &GetComponentTypeInfo<T>() } });
 			mStorageFreePtr += size;
 
 			return ptr;
 		}
 
-		// Gets ownership of object
-		u8* InsertExternal(const UUID& uuid, usize size)
+		// Gets ownership of object, info tells how it is relocated when the arena grows or compacts
+		u8* InsertExternal(const UUID& uuid, usize size, const ComponentTypeInfo* info = nullptr)
 		{
 			CH_PROFILE_FUNCTION();
 			if (mStorageFreePtr + size >= mStorage + mStorageSize)
 				Resize();
 
-			mStorageContent.insert({ uuid, { mStorageFreePtr, size } });
+			mStorageContent.insert({ uuid, { mStorageFreePtr, size, info } });
 			mStorageFreePtr += size;
 
 			return mStorageFreePtr - size;
@@ -61,7 +76,7 @@ namespace Steve
 		{
 			CH_PROFILE_FUNCTION();
 			const auto it = mStorageContent.find(element);
-			T&& to_return = std::move(*static_cast<T*>(it->second.first));
+			T&& to_return = std::move(*static_cast<T*>(it->second.Location));
 			mStorageContent.erase(it);
 
 			mFragHoleSize += sizeof(T);
@@ -74,41 +89,56 @@ namespace Steve
 			CH_PROFILE_FUNCTION();
 			const auto it = mStorageContent.find(element);
 
-			if (it->second.first + it->second.second == mStorageFreePtr)
-				mStorageFreePtr -= it->second.second;
+			if (it->second.Location + it->second.Size == mStorageFreePtr)
+				mStorageFreePtr -= it->second.Size;
 			else
-				mFragHoleSize += it->second.second;
+				mFragHoleSize += it->second.Size;
 			
 			mStorageContent.erase(it);
 		}
 
 		// Returns new location of each component
-		// Memory has already been moved
-		std::unordered_map<UUID, u8*> Defragment()
+		// Memory has already been moved, elements that are not trivially copyable are move constructed
+		// Elements keep their order, so elements that were next to each other still are
+		UUIDMap<u8*> Defragment()
 		{
-			std::unordered_map<UUID, u8*> res;
+			CH_PROFILE_FUNCTION();
+			UUIDMap<u8*> res;
+			res.reserve(mStorageContent.size());
+
+			std::vector<std::pair<const UUID, ArenaElement>*> ordered;
+			ordered.reserve(mStorageContent.size());
+			for (auto& entry : mStorageContent)
+				ordered.push_back(&entry);
+			std::ranges::sort(ordered, {}, [](const auto* entry) { return entry->second.Location; });
 
-			u8* new_storage = (u8*)calloc(mStorageSize, 1);
+			std::shared_ptr<u8> new_buffer = AllocateStorage(mStorageSize);
+			u8* new_storage = new_buffer.get();
 			u8* new_storage_ptr = new_storage;
 
-			for (auto& data : mStorageContent)
+			for (auto* entry : ordered)
 			{
-				memcpy_s(new_storage_ptr, data.second.second, data.second.first, data.second.second);
-				data.second.first = new_storage_ptr;
-				new_storage_ptr += data.second.second;
-
-				res.emplace(data.first, data.second.first);
+				const UUID& id = entry->first;
+				ArenaElement& element = entry->second;
+				if (element.Info != nullptr)
+					RelocateComponent(*element.Info, new_storage_ptr, element.Location);
+				else
+					memcpy_s(new_storage_ptr, element.Size, element.Location, element.Size);
+				element.Location = new_storage_ptr;
+				new_storage_ptr += element.Size;
+
+				res.emplace(id, element.Location);
 			}
 
 			mFragHoleSize = 0;
 
-			free(mStorage);
+			mStorageBuffer = std::move(new_buffer);
 			mStorage = new_storage;
 			mStorageFreePtr = new_storage_ptr;
 
 			return res;
 		}
-		std::optional<std::unordered_map<UUID, u8*>> DefragmentIfNeeded()
+		std::optional<UUIDMap<u8*>> DefragmentIfNeeded()
 		{
 			if ((float)mFragHoleSize / (float)mStorageSize > mFragThreshold)
 			{
@@ -117,41 +147,130 @@ namespace Steve
 			return {};
 		}
 
+		// Bitwise copy of the whole arena, the content table is rebased onto the new storage
+		// Elements that are not trivially copyable still need to be copy constructed over their new slot
+		void CopyStorage(const ArenaContainer& other)
+		{
+			CH_PROFILE_FUNCTION();
+			const usize used = other.mStorageFreePtr - other.mStorage;
+
+			mStorageSize = other.mStorageSize;
+			mStorageBuffer = AllocateStorage(mStorageSize);
+			mStorage = mStorageBuffer.get();
+			memcpy_s(mStorage, mStorageSize, other.mStorage, used);
+			mStorageFreePtr = mStorage + used;
+
+			mFragThreshold = other.mFragThreshold;
+			mFragHoleSize = other.mFragHoleSize;
+
+			mStorageContent.clear();
+			mStorageContent.reserve(other.mStorageContent.size());
+			for (const auto& [id, element] : other.mStorageContent)
+			{
+				mStorageContent.emplace(id, ArenaElement{ Relocate(other, element.Location), element.Size, element.Info });
+			}
+		}
+
+		// Location in this arena of an element at location in other, only valid after CopyStorage
+		[[nodiscard]] u8* Relocate(const ArenaContainer& other, const u8* location) const
+		{
+			return mStorage + (location - other.mStorage);
+		}
+
+		// Hands out a reference to the current storage, the arena stops writing to it after the next Unshare
+		[[nodiscard]] std::shared_ptr<const u8> Share() const { return mStorageBuffer; }
+		[[nodiscard]] bool IsShared() const { return mStorageBuffer.use_count() > 1; }
+
+		// Moves to a private copy of the storage if a snapshot still references it
+		// Returns how far the elements moved, the caller rebases whatever points into the arena
+		std::optional<ptrdiff_t> Unshare()
+		{
+			if (!IsShared())
+				return {};
+
+			CH_PROFILE_FUNCTION();
+			return MoveStorage(mStorageSize);
+		}
+
 		[[nodiscard]] const u8* GetRaw() const { return mStorage; }
-		[[nodiscard]] std::unordered_map<UUID, std::pair<u8*, usize>> GetContent() const { return mStorageContent; }
+		[[nodiscard]] const UUIDMap<ArenaElement>& GetContent() const { return mStorageContent; }
 		[[nodiscard]] usize GetSize() const
 		{
 			usize total_size = 0;
-			for(auto& [ptr, size] : mStorageContent | std::ranges::views::values)
+			for(const ArenaElement& element : mStorageContent | std::ranges::views::values)
 			{
-				total_size += size;
+				total_size += element.Size;
 			}
 			return total_size;
 		}
 
 	protected:
+		// Points a cloned handle to its slot in this arena, copy constructs it if a bitwise copy is not enough
+		void RelocateClone(const ArenaContainer& other, const IHandle& source, IHandle& clone) const
+		{
+			u8* location = Relocate(other, (const u8*)source.Component);
+			if (!source.Info->TriviallyCopyable)
+				source.Info->CopyConstruct(location, (const u8*)source.Component);
+			clone.SetLocation(location);
+		}
+
 		void Resize()
 		{
-			mStorageSize *= 2;
+			MoveStorage(mStorageSize * 2);
+		}
 
-			u8* new_storage = (u8*)realloc(mStorage, mStorageSize);
-			const long long diff = new_storage - mStorage;
-			mStorage = new_storage;
+		// Grows until size more bytes fit, returns how far the storage moved if it had to
+		std::optional<ptrdiff_t> Reserve(usize size)
+		{
+			if (mStorageFreePtr + size < mStorage + mStorageSize)
+				return std::nullopt;
+
+			ptrdiff_t diff = 0;
+			while (mStorageFreePtr + size >= mStorage + mStorageSize)
+				diff += MoveStorage(mStorageSize * 2);
+			return diff;
+		}
+
+		// Zeroed storage, freed by whoever drops the last reference
+		static std::shared_ptr<u8> AllocateStorage(usize size)
+		{
+			return std::shared_ptr<u8>((u8*)calloc(size, 1), free);
+		}
 
-			mStorageFreePtr += diff;
-			for (auto& data : mStorageContent | std::views::values)
+		// Copies the used part to new storage instead of realloc, the old storage can still be read by a snapshot
+		// Elements that are not trivially copyable are move constructed and destroyed at their old place,
+		// a snapshot never reads those from the pool, it keeps its own copies
+		ptrdiff_t MoveStorage(usize new_size)
+		{
+			const usize used = mStorageFreePtr - mStorage;
+			std::shared_ptr<u8> new_buffer = AllocateStorage(new_size);
+			memcpy_s(new_buffer.get(), new_size, mStorage, used);
+
+			const ptrdiff_t diff = (ptrdiff_t)((uintptr_t)new_buffer.get() - (uintptr_t)mStorage);
+			// Kept alive until every element has been relocated out of it
+			const std::shared_ptr<u8> old_buffer = std::exchange(mStorageBuffer, std::move(new_buffer));
+			mStorage = mStorageBuffer.get();
+			mStorageSize = new_size;
+
+			mStorageFreePtr = mStorage + used;
+			for (ArenaElement& element : mStorageContent | std::views::values)
 			{
-				data.first += diff;
+				u8* location = element.Location + diff;
+				// The bitwise copy is only a valid object for trivially copyable types
+				if (element.Info != nullptr && !element.Info->TriviallyCopyable)
+					RelocateComponent(*element.Info, location, element.Location);
+				element.Location = location;
 			}
 
-			mStorageContent.reserve(mStorageSize / 2);
+			return diff;
 		}
 
+		std::shared_ptr<u8> mStorageBuffer;
 		u8* mStorage;
 		u8* mStorageFreePtr;
 		size_t mStorageSize;
 
-		std::unordered_map<const UUID&, std::pair<u8*, usize>> mStorageContent;
+		UUIDMap<ArenaElement> mStorageContent;
 
 		float mFragThreshold;
 		size_t mFragHoleSize;
@@ -177,7 +296,7 @@ namespace Steve
 					using HandleType = std::decay_t<decltype(handle)>;
 					static_assert(std::is_base_of_v<IHandle, HandleType>, "All inputs should be IHandle's");
 					mHandles.emplace(handle->Id, std::forward<HandleType>(handle));
-					handle->Move(InsertExternal(handle->Id, handle->Size));
+					handle->Move(InsertExternal(handle->Id, handle->Size, handle->Info));
 				}(std::forward<T>(handles)), ...);
 		}
 
@@ -186,9 +305,46 @@ namespace Steve
 			Insert((IHandle*)&component_handle);
 		}
 
+		// Reserves uninitialized space for the component and points the handle to it
+		void Allocate(IHandle* handle)
+		{
+			CH_PROFILE_FUNCTION();
+			const uintptr_t storage = (uintptr_t)mStorage;
+			handle->SetLocation(InsertExternal(handle->Id, handle->Size, handle->Info));
+			// Growing moves the arena
+			if ((uintptr_t)mStorage != storage)
+				RebaseHandles((ptrdiff_t)((uintptr_t)mStorage - storage));
+			mHandles.emplace(handle->Id, handle);
+		}
+
+		// Copy on write, see ArenaContainer::Unshare
+		void Unshare()
+		{
+			if (const std::optional<ptrdiff_t> diff = ArenaContainer::Unshare())
+				RebaseHandles(*diff);
+		}
+
+		using ArenaContainer::Share;
+		using ArenaContainer::IsShared;
+
+		// Copies the whole arena at once, the handles of the clone are pointed to their new slots
+		void CloneFrom(const ComponentContainer& other, const HandleRemap& handle_remap)
+		{
+			CH_PROFILE_FUNCTION();
+			CopyStorage(other);
+
+			mHandles.clear();
+			for (const IHandle* source : other.mHandles | std::views::values)
+			{
+				IHandle* clone = handle_remap.at(source);
+				RelocateClone(other, *source, *clone);
+				mHandles.emplace(clone->Id, clone);
+			}
+		}
+
 		void Remove(const UUID& component_uuid)
 		{
-			DefragmentIfNeeded()
+			DefragmentIfNeeded();
 			mHandles.erase(component_uuid);
 			ArenaContainer::Remove(component_uuid);
 		}
@@ -197,6 +353,20 @@ namespace Steve
 			mHandles.erase(component_handle->Id);
 			ArenaContainer::Remove(component_handle->Id);
 		}
+		// Highest address first, so a run at the end of the arena shrinks it instead of leaving holes
+		// Compacts at most once, after everything is removed
+		void Remove(std::span<IHandle* const> component_handles)
+		{
+			CH_PROFILE_FUNCTION();
+			std::vector<IHandle*> sorted(component_handles.begin(), component_handles.end());
+			std::ranges::sort(sorted, std::ranges::greater{}, &IHandle::Component);
+			for (const IHandle* handle : sorted)
+			{
+				mHandles.erase(handle->Id);
+				ArenaContainer::Remove(handle->Id);
+			}
+			DefragmentIfNeeded();
+		}
 		template<typename T> T&& Remove(UUID& component_uuid)
 		{
 			mHandles.erase(component_uuid);
@@ -212,7 +382,7 @@ namespace Steve
 
 		void Defragment()
 		{
-			std::unordered_map<UUID, u8*> defrag = ArenaContainer::Defragment();
+			UUIDMap<u8*> defrag = ArenaContainer::Defragment();
 			for (const auto& [id, loc] : defrag)
 			{
 				mHandles.at(id)->SetLocation(loc);
@@ -226,8 +396,15 @@ namespace Steve
 			}
 		}
 	private:
-		// uuid is member of IHandle
-		std::unordered_map<const UUID&, IHandle*> mHandles;
+		void RebaseHandles(ptrdiff_t diff)
+		{
+			for (IHandle* handle : mHandles | std::views::values)
+			{
+				handle->SetLocation(handle->Component + diff);
+			}
+		}
+
+		UUIDMap<IHandle*> mHandles;
 	};
 
 	// Sequential storage for sets of types
@@ -236,49 +413,96 @@ namespace Steve
 	{
 	public:
 		using TypeInTuple = std::tuple<Ts...>;
-		size_t TotalSize = 0;
+
+		// Every member is padded to the strictest alignment in the tuple, so the next tuple is aligned as well
+		static constexpr usize Alignment = std::max({ alignof(Ts)... });
+		static_assert(Alignment <= alignof(std::max_align_t), "Arena storage is only aligned to max_align_t");
+		static constexpr usize PaddedSize(usize size) { return (size + Alignment - 1) / Alignment * Alignment; }
+		static constexpr usize TotalSize = (PaddedSize(sizeof(Ts)) + ...);
 
 		// initial_size in #Tuples
 		TupleComponentContainer(size_t initial_size = 10, float hole_threshold = 0.1f)
+			: ArenaContainer(initial_size * TotalSize, hole_threshold)
 		{
-			(void(TotalSize += sizeof(Ts)), ...);
-			ArenaContainer(initial_size * TotalSize, hole_threshold);
 		}
 
-		UUID Insert(Handle<Ts>&... handles)
+		// Keyed by the entity that owns the handles
+		// Room for the whole tuple is made first, so growing only has to rebase the tuples already stored
+		void Insert(const UUID& entity_uuid, Handle<Ts>&... handles)
 		{
-			UUID id;
-			mEntities.emplace(id, std::make_tuple(handles...));
-			(void(handles.Move(InsertExternal(handles.Id, handles.Size))), ...);
-			return id;
+			if (const std::optional<ptrdiff_t> diff = Reserve(TotalSize))
+				RebaseHandles(*diff);
+
+			mEntities.emplace(entity_uuid, std::tuple<Handle<Ts>&...>(handles...));
+			(void(handles.Move(InsertExternal(handles.Id, PaddedSize(handles.Size), handles.Info))), ...);
 		}
 
-		void Remove(UUID& entity_uuid)
+		// Hands every handle of the entity to relocate, which gives it a new home, before its slot is freed
+		template<typename F>
+		void Remove(const UUID& entity_uuid, F&& relocate)
 		{
 			CORE_ASSERT(mEntities.contains(entity_uuid), "Does not have this entity")
 
-			std::tuple<Handle<Ts>&...>& handles = mEntities[entity_uuid];
-			ApplyToTuple(handles, [&](auto handle)
+			std::apply([&](auto&... handles)
 				{
-					ArenaContainer::Remove(handle.Id);
-				});
+					(void(relocate((IHandle*)&handles)), ...);
+					(void(ArenaContainer::Remove(handles.Id)), ...);
+				}, mEntities.at(entity_uuid));
 			mEntities.erase(entity_uuid);
+			DefragmentIfNeeded();
 		}
 
-		void Move(UUID& entity_uuid, u8* location)
+		// Compaction keeps the order of the arena, so every tuple stays in one piece
+		void Defragment()
 		{
-			CORE_ASSERT(mEntities.contains(entity_uuid), "Does not have this entity")
+			const UUIDMap<u8*> defrag = ArenaContainer::Defragment();
+			for (auto& handles : mEntities | std::views::values)
+			{
+				std::apply([&](auto&... handle) { (handle.SetLocation(defrag.at(handle.Id)), ...); }, handles);
+			}
+		}
+		void DefragmentIfNeeded()
+		{
+			if (mFragHoleSize > mStorageSize * mFragThreshold)
+			{
+				Defragment();
+			}
+		}
 
-			std::tuple<Handle<Ts>&...>& handles = mEntities[entity_uuid];
-			ApplyToTuple(handles, [&](auto& handle)
-				{
-					handle.Move(location);
-					ArenaContainer::Remove(handle.Id);
-				});
-			mEntities.erase(entity_uuid);
+		// Copies the whole arena at once and rebinds every tuple to the cloned handles
+		void CloneFrom(const TupleComponentContainer& other, const HandleRemap& handle_remap)
+		{
+			CH_PROFILE_FUNCTION();
+			CopyStorage(other);
+
+			mEntities.clear();
+			for (const auto& [id, handles] : other.mEntities)
+			{
+				std::apply([&](auto&... sources)
+					{
+						(RelocateClone(other, sources, *handle_remap.at(&sources)), ...);
+						mEntities.emplace(id, std::tuple<Handle<Ts>&...>((Handle<Ts>&)*handle_remap.at(&sources)...));
+					}, handles);
+			}
 		}
-		
+
+		// Copy on write, see ArenaContainer::Unshare
+		void Unshare()
+		{
+			if (const std::optional<ptrdiff_t> diff = ArenaContainer::Unshare())
+				RebaseHandles(*diff);
+		}
+
 	private:
+		// Points every stored handle at the arena after it moved by diff bytes
+		void RebaseHandles(ptrdiff_t diff)
+		{
+			for (auto& handles : mEntities | std::views::values)
+			{
+				std::apply([&](auto&... handle) { (handle.SetLocation(handle.Component + diff), ...); }, handles);
+			}
+		}
+
 		std::unordered_map<UUID, std::tuple<Handle<Ts>&...>> mEntities;
 	};
 
@@ -294,8 +518,8 @@ namespace Steve
 		void Insert(Handle<T>& handle)
 		{
 			CH_PROFILE_FUNCTION();
-			mHandles.emplace(handle.Id, handle);
-			handle.Move(InsertExternal(handle.Id, handle.Size));
+			mHandles.emplace(handle.Id, &handle);
+			handle.Move(InsertExternal(handle.Id, handle.Size, handle.Info));
 		}
 
 		T&& Remove(const UUID& element)
@@ -318,7 +542,183 @@ namespace Steve
 		[[nodiscard]] inline usize GetSize() const { return mStorageContent.size(); }
 
 	private:
-		std::unordered_map<const UUID&, Handle<T>&> mHandles;
+		UUIDMap<Handle<T>*> mHandles;
+	};
+
+	// Sparse set of entity indices, dense part can be iterated directly
+	class EntitySet
+	{
+	public:
+		bool Insert(u32 entity_index)
+		{
+			if (Contains(entity_index))
+				return false;
+			if (entity_index >= mSparse.size())
+				mSparse.resize(entity_index + 1, InvalidIndex);
+
+			mSparse[entity_index] = (u32)mDense.size();
+			mDense.push_back(entity_index);
+			return true;
+		}
+
+		bool Remove(u32 entity_index)
+		{
+			if (!Contains(entity_index))
+				return false;
+
+			const u32 slot = mSparse[entity_index];
+			const u32 last = mDense.back();
+			mDense[slot] = last;
+			mSparse[last] = slot;
+			mSparse[entity_index] = InvalidIndex;
+			mDense.pop_back();
+			return true;
+		}
+
+		void Clear()
+		{
+			mSparse.clear();
+			mDense.clear();
+		}
+
+		[[nodiscard]] bool Contains(u32 entity_index) const
+		{
+			return entity_index < mSparse.size() && mSparse[entity_index] != InvalidIndex;
+		}
+
+		[[nodiscard]] usize GetSize() const { return mDense.size(); }
+		[[nodiscard]] const std::vector<u32>& GetEntities() const { return mDense; }
+
+	private:
+		std::vector<u32> mSparse;
+		std::vector<u32> mDense;
+	};
+
+	// Sparse set from entity index to the handles of a single component type
+	// Lookup is two array loads, removal swaps with the last element
+	// Also keeps the change tick of the last mutable access per entity
+	// Inserting and removing adds and removes the entity as an owner of the handle, the position in the
+	// owner list is kept per entity so a shared value with many owners loses one in O(1)
+	class ComponentIndex
+	{
+	public:
+		void Insert(u32 entity_index, IHandle* handle, u32 change_tick)
+		{
+			CORE_ASSERT(!Contains(entity_index), "Entity already has a component of this type")
+			if (entity_index >= mSparse.size())
+				mSparse.resize(entity_index + 1, InvalidIndex);
+
+			mSparse[entity_index] = (u32)mDense.size();
+			mDense.push_back(handle);
+			mDenseEntities.push_back(entity_index);
+			mChangeTicks.push_back(change_tick);
+			mOwnerSlots.push_back((u32)handle->mOwners.size());
+			handle->mOwners.push_back(entity_index);
+		}
+
+		void Remove(u32 entity_index)
+		{
+			CORE_ASSERT(Contains(entity_index), "Entity does not have a component of this type")
+			const u32 slot = mSparse[entity_index];
+			const u32 last = mDenseEntities.back();
+
+			// Last owner takes the place of the removed one
+			std::vector<u32>& owners = mDense[slot]->mOwners;
+			const u32 owner_slot = mOwnerSlots[slot];
+			const u32 last_owner = owners.back();
+			owners[owner_slot] = last_owner;
+			mOwnerSlots[mSparse[last_owner]] = owner_slot;
+			owners.pop_back();
+
+			mDense[slot] = mDense.back();
+			mDenseEntities[slot] = last;
+			mChangeTicks[slot] = mChangeTicks.back();
+			mOwnerSlots[slot] = mOwnerSlots.back();
+			mSparse[last] = slot;
+			mSparse[entity_index] = InvalidIndex;
+
+			mDense.pop_back();
+			mDenseEntities.pop_back();
+			mChangeTicks.pop_back();
+			mOwnerSlots.pop_back();
+		}
+
+		// Returns the handle and stamps it as changed
+		[[nodiscard]] IHandle* GetMutable(u32 entity_index, u32 change_tick)
+		{
+			const u32 slot = mSparse[entity_index];
+			mChangeTicks[slot] = change_tick;
+			return mDense[slot];
+		}
+		[[nodiscard]] u32 GetChangeTick(u32 entity_index) const { return mChangeTicks[mSparse[entity_index]]; }
+
+		// Points the entry of entity_index to a different handle, used when cloning
+		void Replace(u32 entity_index, IHandle* handle) { mDense[mSparse[entity_index]] = handle; }
+
+		[[nodiscard]] bool Contains(u32 entity_index) const
+		{
+			return entity_index < mSparse.size() && mSparse[entity_index] != InvalidIndex;
+		}
+
+		[[nodiscard]] IHandle* Get(u32 entity_index) const { return mDense[mSparse[entity_index]]; }
+		[[nodiscard]] usize GetSize() const { return mDense.size(); }
+		[[nodiscard]] const std::vector<IHandle*>& GetHandles() const { return mDense; }
+		[[nodiscard]] const std::vector<u32>& GetEntities() const { return mDenseEntities; }
+
+	private:
+		std::vector<u32> mSparse;
+		std::vector<IHandle*> mDense;
+		std::vector<u32> mDenseEntities;
+		std::vector<u32> mChangeTicks;
+		// Position of the entity in the owner list of its handle
+		std::vector<u32> mOwnerSlots;
+	};
+
+	// Slab of objects that never move, allocated in chunks of ChunkCount and reused through a free list
+	// Objects still alive when the pool goes away are not destroyed, their owner has to do that
+	template<typename T, usize ChunkCount = 256>
+	class ObjectPool
+	{
+	public:
+		ObjectPool() = default;
+		ObjectPool(const ObjectPool&) = delete;
+		ObjectPool(ObjectPool&&) = default;
+		ObjectPool& operator=(ObjectPool&&) = default;
+
+		template<typename ...Args>
+		[[nodiscard]] T* Create(Args&&... args)
+		{
+			if (mFree.empty())
+				AddChunk();
+
+			Slot* slot = mFree.back();
+			mFree.pop_back();
+			return new(slot) T(std::forward<Args>(args)...);
+		}
+
+		void Destroy(T* object)
+		{
+			std::destroy_at(object);
+			mFree.push_back((Slot*)object);
+		}
+
+	private:
+		struct alignas(T) Slot
+		{
+			u8 Bytes[sizeof(T)];
+		};
+
+		// Free list in reverse, so the chunk is handed out front to back
+		void AddChunk()
+		{
+			Slot* chunk = mChunks.emplace_back(std::make_unique<Slot[]>(ChunkCount)).get();
+			for (usize i = ChunkCount; i > 0; i--)
+				mFree.push_back(chunk + i - 1);
+		}
+
+	private:
+		std::vector<std::unique_ptr<Slot[]>> mChunks;
+		std::vector<Slot*> mFree;
 	};
 
 	/// class GroupContainer in Group.h
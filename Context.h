@@ -0,0 +1,198 @@
+#ifndef CONTEXT_HEADER_
+#define CONTEXT_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/Logger.h"
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Steve
+{
+	// Small per type index for resources, assigned on first use like ComponentId
+	using ResourceId = u32;
+	constexpr usize MaxResourceTypes = 64;
+
+	inline ResourceId NextResourceId()
+	{
+		static std::atomic<ResourceId> next = 0;
+		const ResourceId id = next++;
+		// Fatal in every build, like NextComponentId
+		if (id >= MaxResourceTypes)
+		{
+			CORE_ERROR("Too many resource types, raise MaxResourceTypes ({})", MaxResourceTypes);
+			std::abort();
+		}
+		return id;
+	}
+
+	// Resolved once per type, after that it is a static load
+	template<typename T>
+	[[nodiscard]] ResourceId GetResourceId()
+	{
+		static const ResourceId id = NextResourceId();
+		return id;
+	}
+
+	template<typename T>
+	[[nodiscard]] ResourceId GetResourceIdOf()
+	{
+		return GetResourceId<std::remove_cvref_t<T>>();
+	}
+
+	// Resources a system reads and writes, const T is a read, T a write
+	// A scheduler can run two systems at the same time if their access does not conflict
+	struct ContextAccess
+	{
+		std::bitset<MaxResourceTypes> Reads;
+		std::bitset<MaxResourceTypes> Writes;
+
+		template<typename ...Ts>
+		[[nodiscard]] static const ContextAccess& Of()
+		{
+			static const ContextAccess access = []()
+				{
+					ContextAccess result;
+					(void((std::is_const_v<std::remove_reference_t<Ts>> ? result.Reads : result.Writes).set(GetResourceIdOf<Ts>())), ...);
+					return result;
+				}();
+			return access;
+		}
+
+		// One of them writes what the other one touches
+		[[nodiscard]] bool ConflictsWith(const ContextAccess& other) const
+		{
+			return (Writes & (other.Reads | other.Writes)).any() || (Reads & other.Writes).any();
+		}
+
+		// Writes allow reads too
+		template<typename T>
+		[[nodiscard]] bool Allows() const
+		{
+			const ResourceId id = GetResourceIdOf<T>();
+			return std::is_const_v<std::remove_reference_t<T>> ? Reads.test(id) || Writes.test(id) : Writes.test(id);
+		}
+	};
+
+	// Registry wide singletons like time, input or settings, owned by the Registry, see Registry::Ctx
+	// One slot per ResourceId, so a lookup is an array index to a direct pointer
+	class Context
+	{
+	public:
+		Context() = default;
+		Context(const Context&) = delete;
+		Context& operator=(const Context&) = delete;
+
+		~Context()
+		{
+			for (Slot& slot : mSlots)
+			{
+				if (slot.Data != nullptr)
+					slot.Destroy(slot.Data);
+			}
+		}
+
+		template<typename T, typename ...Args>
+		T& Emplace(Args&&... args)
+		{
+			static_assert(!std::is_const_v<T> && !std::is_reference_v<T>, "Resources are stored by value");
+			CheckAccess<T>();
+			Slot& slot = mSlots[GetResourceId<T>()];
+			// Built before the old one goes, args may refer to it and a throwing constructor leaves the slot as it was
+			T* resource = new T(std::forward<Args>(args)...);
+			if (slot.Data != nullptr)
+				slot.Destroy(slot.Data);
+
+			slot.Data = resource;
+			slot.Destroy = [](void* data) { delete (T*)data; };
+			slot.Copy = []() -> void* (*)(const void*)
+			{
+				if constexpr (std::is_copy_constructible_v<T>)
+					return [](const void* data) -> void* { return new T(*(const T*)data); };
+				else
+					return nullptr;
+			}();
+			return *(T*)slot.Data;
+		}
+
+		// nullptr if there is none, const T gives a pointer to const
+		template<typename T>
+		[[nodiscard]] T* Find() const
+		{
+			CheckAccess<T>();
+			return (T*)mSlots[GetResourceIdOf<T>()].Data;
+		}
+
+		template<typename T>
+		void Erase()
+		{
+			CheckAccess<std::remove_cvref_t<T>>();
+			Slot& slot = mSlots[GetResourceIdOf<T>()];
+			if (slot.Data != nullptr)
+				slot.Destroy(slot.Data);
+			slot = {};
+		}
+
+		// Every Find, Emplace and Erase on the calling thread is checked against access until the next call, nullptr turns the check off
+		// Catches systems that touch resources they did not declare, so their declared access can be trusted for scheduling
+		// Kept per thread, systems running at the same time each check against their own access
+		void SetDeclaredAccess(const ContextAccess* access) { Declared() = { this, access }; }
+
+		// Copies every copyable resource, for cloning a registry
+		void CopyFrom(const Context& other)
+		{
+			for (usize id = 0; id < MaxResourceTypes; id++)
+			{
+				const Slot& source = other.mSlots[id];
+				if (source.Data == nullptr || source.Copy == nullptr)
+					continue;
+
+				Slot& slot = mSlots[id];
+				if (slot.Data != nullptr)
+					slot.Destroy(slot.Data);
+				slot = source;
+				slot.Data = source.Copy(source.Data);
+			}
+		}
+
+	private:
+		struct Slot
+		{
+			void* Data = nullptr;
+			void (*Destroy)(void* data) = nullptr;
+			// nullptr if the type cannot be copied
+			void* (*Copy)(const void* data) = nullptr;
+		};
+
+		// A thread runs one system at a time, Owner keeps the access from applying to other contexts
+		struct Declaration
+		{
+			const Context* Owner = nullptr;
+			const ContextAccess* Access = nullptr;
+		};
+
+		static Declaration& Declared()
+		{
+			thread_local Declaration declared;
+			return declared;
+		}
+
+		template<typename T>
+		void CheckAccess() const
+		{
+			const Declaration& declared = Declared();
+			CORE_ASSERT(declared.Owner != this || declared.Access == nullptr || declared.Access->Allows<T>(), "Resource access was not declared")
+		}
+
+	private:
+		std::array<Slot, MaxResourceTypes> mSlots;
+	};
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef DOUBLE_BUFFERED_HEADER_
+#define DOUBLE_BUFFERED_HEADER_
+
+#include "Steve/Core/Core.h"
+
+namespace Steve
+{
+	// Storage policy for components that other systems read while the simulation writes them
+	// Readers get the front value of the last tick, writers fill the back value and
+	// Registry::SwapBuffers flips every DoubleBuffered component at once
+	// In a view: const DoubleBuffered<T> yields const T& (front), DoubleBuffered<T> yields T& (back)
+	// Reader threads get their views from Registry::GetReadView, which never creates a query
+	// Writers are expected to write the whole back value each tick, it is two ticks old after a swap
+	template<typename T>
+	struct DoubleBuffered
+	{
+		DoubleBuffered(const T& value = T()) : mBuffers{ value, value } {}
+
+		[[nodiscard]] const T& Front(u32 front_buffer) const { return mBuffers[front_buffer]; }
+		[[nodiscard]] T& Back(u32 front_buffer) { return mBuffers[front_buffer ^ 1]; }
+
+	private:
+		T mBuffers[2];
+	};
+}
+
+#endif
@@ -1,5 +1,24 @@
 #include "Entity.h"
+#include "Registry.h"
 
 namespace Steve {
 
+	void Entity::RemoveChildEntity(Entity* entity)
+	{
+		CORE_ASSERT(entity->mParent == mIndex, "Entity is not a child of this entity")
+		u32* link = &mFirstChild;
+		while (*link != entity->mIndex)
+			link = &mRegistry->mData.Entities[*link].mNextSibling;
+
+		*link = entity->mNextSibling;
+		entity->mParent = InvalidIndex;
+		entity->mNextSibling = InvalidIndex;
+	}
+
+	void Entity::SetComponentBit(ComponentId id, bool value)
+	{
+		mSignature.set(id, value);
+		mRegistry->SignatureChanged(*this, id);
+	}
+
 }  // namespace Steve
@@ -6,11 +6,10 @@
 #include "Steve/Core/Logger.h"
 #include "Steve/Core/Profiling.h"
 
-#include "Registry.h"
+#include "ComponentInfo.h"
 #include "Handle.h"
+#include "Query.h"
 
-#include <set>
-#include <map>
 #include <tuple>
 #include <typeindex>
 #include <type_traits>
@@ -18,117 +17,126 @@
 
 namespace Steve
 {
+	// The members that go through mRegistry are defined at the end of Registry.h, once Registry is complete
+	class Registry;
 
 	// Only contains 1 of a component type
+	// Fixed size record, the components are found through the per type ComponentIndex in RegistryData
 	class Entity
 	{
 		friend class Registry;
 
 	public:
 
-		Entity(Registry* registry) : mRegistry(registry) {}
+		Entity(Registry* registry, u32 index, const UUID& id = UUID()) : Id(id), mIndex(index), mRegistry(registry) {}
 		~Entity() = default;
 
 		bool operator==(const Entity& other){return Id == other.Id;}
 
 		
+		// Mutable access copies the pool first if a snapshot still shares it, and counts as a change
 		template<typename T>
-		[[nodiscard]] Handle<T>& GetComponent()
-		{
-			CH_PROFILE_FUNCTION();
-			const std::type_index type(typeid(T));
-			CORE_ASSERT(mComponentIds.contains(type), "Component with this type does not exist")
+		[[nodiscard]] Handle<T>& GetComponent();
 
-			return &(Handle<T>*)mComponentHandles.at(mComponentIds[type]);
+		// nullptr if the entity does not have T
+		template<typename T>
+		[[nodiscard]] Handle<T>* FindComponent()
+		{
+			static_assert(!TagComponent<T>, "Tags have no data, use Contains");
+			return Contains<T>() ? &GetComponent<T>() : nullptr;
 		}
 
+		// Tags are skipped
 		template<typename ...Ts>
-		[[nodiscard]] std::tuple<Handle<Ts>&...> GetComponents()
+		[[nodiscard]] HandleTuple_t<Ts...> GetComponents()
 		{
-			std::tuple<Handle<Ts>&...> res;
-			ApplyToTuple(res, [&, this]<typename T>(T& handle)
-				{
-					handle = GetComponent<typename RemoveHandle<T>::type>();
-				});
-			return res;
+			return std::tuple_cat(GetComponentTuple<Ts>()...);
 		}
 
-		// Checks if any of the types are here
+		// Checks if all of the types are here
 		template<typename ...T>
 		[[nodiscard]] bool ContainsAll() const
 		{
-			CH_PROFILE_FUNCTION();
-			
-			([&, this]<typename T>() {
-				if (!Contains(std::type_index(typeid(T)))) return false;
-			}, ...);
-
-			return true;
+			return ContainsAll(MakeSignature<T...>());
 		}
-		[[nodiscard]] bool ContainsAll(std::vector<std::type_index>& types) const
+		[[nodiscard]] bool ContainsAll(const Signature& types) const
 		{
-			for(auto& type : types)
-			{
-				if (!Contains(type)) return false;
-			}
-			return true;
+			return (mSignature & types) == types;
 		}
 
 		template<typename T>
 		[[nodiscard]] bool Contains() const
 		{
-			return mComponentIds.contains(std::type_index(typeid(T)));
+			return mSignature.test(GetComponentId<T>());
 		}
-		[[nodiscard]] bool Contains(std::type_index& type) const
+		[[nodiscard]] bool Contains(ComponentId type) const
 		{
-			return mComponentIds.contains(type);
+			return mSignature.test(type);
 		}
 
+		[[nodiscard]] const Signature& GetSignature() const { return mSignature; }
+		[[nodiscard]] u32 GetIndex() const { return mIndex; }
+
+		// Placeholder records (reserved but not yet merged index) are not alive
+		[[nodiscard]] bool IsAlive() const { return mIndex != InvalidIndex; }
+		// Marked by Registry::MarkForDestroy, still alive until the next Registry::Flush
+		[[nodiscard]] bool IsPendingDestroy() const { return Contains<PendingDestroy>(); }
+
 		// Shortcut to registry function
 		template<typename T>
-		Handle<T>& AddComponent(T&& component) { return mRegistry->AddComponent(this, component); }
+		decltype(auto) AddComponent(T&& component);
+
+		template<TagComponent T>
+		void AddComponent() { SetComponentBit(GetComponentId<T>(), true); }
+
+		// Shortcut to registry function
+		template<typename ...Ts>
+		void AddComponents(Ts&&... components);
+
+		// Shortcut to registry function
+		template<typename ...Ts>
+		void RemoveComponents();
 
 		// Shortcut to registry function
 		template<typename T>
-		void DestroyComponent() { mRegistry->DestroyComponent(mComponentHandles[mComponentIds[std::type_index(typeid(T))]]); }
+		void DestroyComponent();
 
 
 		void AddChildEntity(Entity* entity)
 		{
-			mChildren.emplace(entity->Id, entity);
-		}
-		void RemoveChildEntity(Entity* entity)
-		{
-			mChildren.erase(entity->Id);
+			CORE_ASSERT(entity->mParent == InvalidIndex, "Entity already has a parent")
+			entity->mParent = mIndex;
+			entity->mNextSibling = mFirstChild;
+			mFirstChild = entity->mIndex;
 		}
-		std::map<const UUID&, Entity*>& GetChildren() { return mChildren; }
+		void RemoveChildEntity(Entity* entity);
+
+		template<typename F>
+		void ForEachChild(F&& function);
 
 	private:
-		void AddedComponent(IHandle* handle)
+		template<typename T>
+		auto GetComponentTuple()
 		{
-			mComponentIds.emplace(handle->Type, handle->Id);
-			mComponentHandles.emplace(handle->Id, handle);
-
-			handle->mOwners.push_back(Id);
+			if constexpr (TagComponent<T>)
+				return std::tuple<>();
+			else
+				return std::tuple<Handle<T>&>(GetComponent<T>());
 		}
-		
-		void RemovedComponent(IHandle* handle)
-		{
-			CORE_ASSERT(mComponentIds.contains(handle->Type), "component not in mComponentIds")
-			CORE_ASSERT(mComponentHandles.contains(handle->Id), "component not in mComponentHandles")
 
-			mComponentIds.erase(handle->Type);
-			mComponentHandles.erase(handle->Id);
-
-			handle->mOwners.erase(Id);
-		}
+		// Every signature change goes through here so the registry can update its queries
+		void SetComponentBit(ComponentId id, bool value);
 
 	public:
 		const UUID Id;
 	private:
-		std::unordered_map<std::type_index, const UUID&> mComponentIds;
-		std::unordered_map<const UUID&, IHandle*> mComponentHandles;
-		std::map<const UUID&, Entity*> mChildren;
+		u32 mIndex;
+		Signature mSignature;
+
+		// Hierarchy as an intrusive list of entity indices
+		u32 mParent = InvalidIndex;
+		u32 mFirstChild = InvalidIndex;
+		u32 mNextSibling = InvalidIndex;
 
 		Registry* mRegistry;
 	};
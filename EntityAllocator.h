@@ -0,0 +1,106 @@
+#ifndef ENTITY_ALLOCATOR_HEADER_
+#define ENTITY_ALLOCATOR_HEADER_
+
+#include "Steve/Core/Core.h"
+
+#include "ComponentInfo.h"
+
+#include <array>
+#include <atomic>
+
+namespace Steve
+{
+	// Hands out entity indices, Reserve and Release are lock free and can be called from any thread
+	// Freed indices go on an atomic free list, its links live in pages that never move once allocated
+	class EntityAllocator
+	{
+	public:
+		EntityAllocator() = default;
+		EntityAllocator(const EntityAllocator&) = delete;
+		~EntityAllocator()
+		{
+			for (std::atomic<std::atomic<u32>*>& page : mPages)
+				delete[] page.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] u32 Reserve()
+		{
+			u64 head = mFreeHead.load(std::memory_order_acquire);
+			while ((u32)head != InvalidIndex)
+			{
+				// High half is a tag, so a pop/push of the same index in between cannot fool the CAS
+				const u64 next = (((head >> 32) + 1) << 32) | GetLink((u32)head).load(std::memory_order_relaxed);
+				if (mFreeHead.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+					return (u32)head;
+			}
+			return mNext.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void Release(u32 index)
+		{
+			CORE_ASSERT((index >> PageBits) < MaxPages, "Entity index out of range for the free list")
+			std::atomic<u32>& link = GetOrCreatePage(index >> PageBits)[index & (PageSize - 1)];
+
+			u64 head = mFreeHead.load(std::memory_order_relaxed);
+			do
+			{
+				link.store((u32)head, std::memory_order_relaxed);
+			} while (!mFreeHead.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | index, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		// Not thread safe, for cloning a registry
+		void CopyFrom(const EntityAllocator& other)
+		{
+			mFreeHead.store(other.mFreeHead.load());
+			mNext.store(other.mNext.load());
+			for (u32 page = 0; page < MaxPages; page++)
+			{
+				const std::atomic<u32>* source = other.mPages[page].load();
+				if (source == nullptr)
+					continue;
+
+				std::atomic<u32>* links = GetOrCreatePage(page);
+				for (u32 i = 0; i < PageSize; i++)
+					links[i].store(source[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+		}
+
+		// Every index below this has been handed out at some point
+		[[nodiscard]] u32 GetHighWaterMark() const { return mNext.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr u32 PageBits = 16;
+		static constexpr u32 PageSize = 1u << PageBits;
+		static constexpr u32 MaxPages = 4096;
+
+		// Only for indices that have been released, so their page exists
+		[[nodiscard]] std::atomic<u32>& GetLink(u32 index) const
+		{
+			return mPages[index >> PageBits].load(std::memory_order_acquire)[index & (PageSize - 1)];
+		}
+
+		// Two threads can race to create a page, the loser frees its own
+		std::atomic<u32>* GetOrCreatePage(u32 page)
+		{
+			std::atomic<u32>* links = mPages[page].load(std::memory_order_acquire);
+			if (links != nullptr)
+				return links;
+
+			std::atomic<u32>* created = new std::atomic<u32>[PageSize];
+			if (mPages[page].compare_exchange_strong(links, created, std::memory_order_acq_rel, std::memory_order_acquire))
+				return created;
+
+			delete[] created;
+			return links;
+		}
+
+		// Low half is the first free index, high half the ABA tag
+		std::atomic<u64> mFreeHead = InvalidIndex;
+		std::atomic<u32> mNext = 0;
+
+		// Free list links, a page is allocated by the first Release into it and never moves
+		std::array<std::atomic<std::atomic<u32>*>, MaxPages> mPages{};
+	};
+}
+
+#endif
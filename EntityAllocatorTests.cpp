@@ -0,0 +1,95 @@
+#include "EntityAllocator.h"
+#include "Testing.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Steve;
+
+namespace
+{
+	// Indices are handed out once until they are released, even across free list pages
+	void ReuseAcrossPages()
+	{
+		EntityAllocator allocator;
+		constexpr u32 count = 70000;
+		for (u32 i = 0; i < count; i++)
+			CHECK(allocator.Reserve() == i);
+		for (u32 i = 0; i < count; i++)
+			allocator.Release(i);
+
+		std::vector<bool> seen(count, false);
+		for (u32 i = 0; i < count; i++)
+		{
+			const u32 index = allocator.Reserve();
+			CHECK(index < count && !seen[index]);
+			if (index < count)
+				seen[index] = true;
+		}
+		CHECK(allocator.Reserve() == count);
+		CHECK(allocator.GetHighWaterMark() == count + 1);
+
+		EntityAllocator copy;
+		allocator.Release(5);
+		allocator.Release(count - 1);
+		copy.CopyFrom(allocator);
+		CHECK(copy.Reserve() == count - 1);
+		CHECK(copy.Reserve() == 5);
+	}
+
+	// Every thread reserves and releases at once, an index may never be held by two threads
+	void ConcurrentReserveRelease()
+	{
+		EntityAllocator allocator;
+		constexpr u32 threads = 8;
+		constexpr u32 rounds = 50000;
+		constexpr u32 held = 16;
+		constexpr u32 max_index = threads * (held + 1) + 1;
+
+		std::unique_ptr<std::atomic<bool>[]> owned = std::make_unique<std::atomic<bool>[]>(max_index);
+		std::atomic<u32> double_owned = 0;
+		std::atomic<u32> out_of_range = 0;
+
+		std::vector<std::jthread> workers;
+		for (u32 thread = 0; thread < threads; thread++)
+		{
+			workers.emplace_back([&]()
+				{
+					std::vector<u32> mine;
+					for (u32 round = 0; round < rounds; round++)
+					{
+						const u32 index = allocator.Reserve();
+						if (index >= max_index)
+						{
+							out_of_range++;
+							continue;
+						}
+						if (owned[index].exchange(true))
+							double_owned++;
+						mine.push_back(index);
+
+						if (mine.size() > held)
+						{
+							owned[mine.front()].store(false);
+							allocator.Release(mine.front());
+							mine.erase(mine.begin());
+						}
+					}
+				});
+		}
+		workers.clear();
+
+		CHECK(double_owned == 0);
+		CHECK(out_of_range == 0);
+		CHECK(allocator.GetHighWaterMark() <= max_index);
+	}
+}
+
+int main()
+{
+	ReuseAcrossPages();
+	ConcurrentReserveRelease();
+	return Steve::Testing::Result();
+}
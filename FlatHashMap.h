@@ -0,0 +1,419 @@
+#ifndef FLAT_HASH_MAP_HEADER_
+#define FLAT_HASH_MAP_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/UUID.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEVE_FLAT_HASH_SSE2 1
+#endif
+
+namespace Steve
+{
+	// UUIDs are random, so their own bits already are a good hash
+	struct UUIDHash
+	{
+		[[nodiscard]] u64 operator()(const UUID& id) const
+		{
+			static_assert(sizeof(UUID) >= sizeof(u64) && std::is_trivially_copyable_v<UUID>, "UUID bits cannot be used as hash");
+			u64 bits;
+			memcpy(&bits, &id, sizeof(bits));
+			return bits;
+		}
+	};
+
+	// Open addressing map in the style of a Swiss table
+	// One control byte per slot holds 7 bits of the hash, a group of 16 control bytes is compared at once with SSE2
+	// Slots are stored inline, so references are invalidated by inserts that grow the table and by rehashes
+	template<typename K, typename V, typename Hash = std::hash<K>>
+	class FlatHashMap
+	{
+	public:
+		using key_type = K;
+		using mapped_type = V;
+		using value_type = std::pair<const K, V>;
+
+		template<bool Const>
+		class Iterator
+		{
+			friend class FlatHashMap;
+			using Map = std::conditional_t<Const, const FlatHashMap, FlatHashMap>;
+
+		public:
+			using iterator_concept = std::forward_iterator_tag;
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = FlatHashMap::value_type;
+			using difference_type = std::ptrdiff_t;
+			using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+			using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+			Iterator() = default;
+			// Mutable to const
+			template<bool IsConst = Const> requires IsConst
+			Iterator(const Iterator<false>& other) : mMap(other.mMap), mIndex(other.mIndex) {}
+
+			reference operator*() const { return mMap->mSlots[mIndex]; }
+			pointer operator->() const { return &mMap->mSlots[mIndex]; }
+
+			Iterator& operator++()
+			{
+				mIndex = mMap->NextFull(mIndex + 1);
+				return *this;
+			}
+			Iterator operator++(int)
+			{
+				Iterator tmp = *this;
+				operator++();
+				return tmp;
+			}
+
+			bool operator==(const Iterator& other) const { return mIndex == other.mIndex; }
+
+		private:
+			Iterator(Map* map, usize index) : mMap(map), mIndex(index) {}
+
+			Map* mMap = nullptr;
+			usize mIndex = 0;
+
+			friend class Iterator<!Const>;
+		};
+
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		FlatHashMap() = default;
+		FlatHashMap(const FlatHashMap& other) { CopyFrom(other); }
+		FlatHashMap(FlatHashMap&& other) noexcept { Swap(other); }
+		~FlatHashMap() { Release(); }
+
+		FlatHashMap& operator=(const FlatHashMap& other)
+		{
+			if (this != &other)
+			{
+				Release();
+				CopyFrom(other);
+			}
+			return *this;
+		}
+		FlatHashMap& operator=(FlatHashMap&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				Swap(other);
+			}
+			return *this;
+		}
+
+		iterator begin() { return { this, NextFull(0) }; }
+		iterator end() { return { this, mCapacity }; }
+		const_iterator begin() const { return { this, NextFull(0) }; }
+		const_iterator end() const { return { this, mCapacity }; }
+
+		[[nodiscard]] usize size() const { return mSize; }
+		[[nodiscard]] bool empty() const { return mSize == 0; }
+
+		// Bulk reserve, count elements fit without growing
+		void reserve(usize count)
+		{
+			if (count > mSize + mGrowthLeft)
+				Rehash(CapacityFor(count));
+		}
+
+		void clear()
+		{
+			DestroySlots();
+			if (mCapacity > 0)
+				memset(mControl, Empty, mCapacity);
+			mSize = 0;
+			mGrowthLeft = MaxLoad(mCapacity);
+		}
+
+		[[nodiscard]] iterator find(const K& key) { return { this, Find(key) }; }
+		[[nodiscard]] const_iterator find(const K& key) const { return { this, Find(key) }; }
+		[[nodiscard]] bool contains(const K& key) const { return Find(key) != mCapacity; }
+		[[nodiscard]] usize count(const K& key) const { return contains(key) ? 1 : 0; }
+
+		[[nodiscard]] V& at(const K& key)
+		{
+			const usize index = Find(key);
+			CORE_ASSERT(index != mCapacity, "Key is not in the map")
+			return mSlots[index].second;
+		}
+		[[nodiscard]] const V& at(const K& key) const
+		{
+			const usize index = Find(key);
+			CORE_ASSERT(index != mCapacity, "Key is not in the map")
+			return mSlots[index].second;
+		}
+
+		V& operator[](const K& key) { return emplace(key).first->second; }
+
+		// Does nothing if key is already in the map
+		template<typename ...Args>
+		std::pair<iterator, bool> emplace(const K& key, Args&&... args)
+		{
+			const u64 hash = Hash{}(key);
+			const usize found = Find(key, hash);
+			if (found != mCapacity)
+				return { iterator(this, found), false };
+
+			if (mGrowthLeft == 0)
+				Grow();
+
+			const usize index = FindFree(hash);
+			if (mControl[index] == Empty)
+				mGrowthLeft--;
+			mControl[index] = H2(hash);
+			new(&mSlots[index]) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+			mSize++;
+			return { iterator(this, index), true };
+		}
+
+		std::pair<iterator, bool> insert(const value_type& value) { return emplace(value.first, value.second); }
+		std::pair<iterator, bool> insert(value_type&& value) { return emplace(value.first, std::move(value.second)); }
+
+		// The slot becomes a tombstone, it is reused by inserts and dropped on the next rehash
+		iterator erase(const_iterator it)
+		{
+			EraseAt(it.mIndex);
+			return { this, NextFull(it.mIndex + 1) };
+		}
+		iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+		usize erase(const K& key)
+		{
+			const usize index = Find(key);
+			if (index == mCapacity)
+				return 0;
+			EraseAt(index);
+			return 1;
+		}
+
+	private:
+		using ControlByte = int8_t;
+		static constexpr usize GroupSize = 16;
+		static constexpr ControlByte Empty = -128;
+		static constexpr ControlByte Deleted = -2;
+		// Full slots hold the low 7 bits of the hash, so they are never negative
+
+		[[nodiscard]] static ControlByte H2(u64 hash) { return (ControlByte)(hash & 0x7F); }
+		[[nodiscard]] static usize H1(u64 hash) { return (usize)(hash >> 7); }
+
+		// 7/8 load, tombstones count as load
+		[[nodiscard]] static usize MaxLoad(usize capacity) { return capacity - capacity / 8; }
+		[[nodiscard]] static usize CapacityFor(usize count)
+		{
+			usize capacity = GroupSize;
+			while (MaxLoad(capacity) < count)
+				capacity *= 2;
+			return capacity;
+		}
+
+		// Bit per slot of the group at base whose control byte is value
+		[[nodiscard]] u32 Match(usize base, ControlByte value) const
+		{
+#ifdef STEVE_FLAT_HASH_SSE2
+			const __m128i group = _mm_load_si128((const __m128i*)(mControl + base));
+			return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+			u32 mask = 0;
+			for (usize i = 0; i < GroupSize; i++)
+				mask |= (u32)(mControl[base + i] == value) << i;
+			return mask;
+#endif
+		}
+
+		// Empty and deleted slots, both have the high bit set
+		[[nodiscard]] u32 MatchFree(usize base) const
+		{
+#ifdef STEVE_FLAT_HASH_SSE2
+			return (u32)_mm_movemask_epi8(_mm_load_si128((const __m128i*)(mControl + base)));
+#else
+			u32 mask = 0;
+			for (usize i = 0; i < GroupSize; i++)
+				mask |= (u32)(mControl[base + i] < 0) << i;
+			return mask;
+#endif
+		}
+
+		// Triangular probing over whole groups visits every group once
+		[[nodiscard]] usize Find(const K& key) const { return mCapacity == 0 ? 0 : Find(key, Hash{}(key)); }
+		[[nodiscard]] usize Find(const K& key, u64 hash) const
+		{
+			if (mCapacity == 0)
+				return 0;
+
+			const usize group_mask = mCapacity / GroupSize - 1;
+			usize group = H1(hash) & group_mask;
+			for (usize step = 1;; step++)
+			{
+				const usize base = group * GroupSize;
+				for (u32 match = Match(base, H2(hash)); match != 0; match &= match - 1)
+				{
+					const usize index = base + std::countr_zero(match);
+					if (mSlots[index].first == key)
+						return index;
+				}
+
+				// An empty slot ends the probe sequence, the key would have been placed there
+				if (Match(base, Empty) != 0)
+					return mCapacity;
+				group = (group + step) & group_mask;
+			}
+		}
+
+		[[nodiscard]] usize FindFree(u64 hash) const
+		{
+			const usize group_mask = mCapacity / GroupSize - 1;
+			usize group = H1(hash) & group_mask;
+			for (usize step = 1;; step++)
+			{
+				const usize base = group * GroupSize;
+				if (const u32 free = MatchFree(base); free != 0)
+					return base + std::countr_zero(free);
+				group = (group + step) & group_mask;
+			}
+		}
+
+		[[nodiscard]] usize NextFull(usize index) const
+		{
+			while (index < mCapacity && mControl[index] < 0)
+				index++;
+			return index;
+		}
+
+		void EraseAt(usize index)
+		{
+			mSlots[index].~value_type();
+			mControl[index] = Deleted;
+			mSize--;
+		}
+
+		// Doubles, unless most of the load is tombstones
+		void Grow()
+		{
+			if (mCapacity == 0)
+				Rehash(GroupSize);
+			else
+				Rehash(mSize * 2 < MaxLoad(mCapacity) ? mCapacity : mCapacity * 2);
+		}
+
+		void Rehash(usize capacity)
+		{
+			ControlByte* old_control = mControl;
+			value_type* old_slots = mSlots;
+			const usize old_capacity = mCapacity;
+
+			Allocate(capacity);
+			for (usize i = 0; i < old_capacity; i++)
+			{
+				if (old_control[i] < 0)
+					continue;
+
+				const u64 hash = Hash{}(old_slots[i].first);
+				const usize index = FindFree(hash);
+				mControl[index] = H2(hash);
+				new(&mSlots[index]) value_type(std::move(old_slots[i]));
+				old_slots[i].~value_type();
+			}
+			mGrowthLeft -= mSize;
+
+			Free(old_control, old_slots, old_capacity);
+		}
+
+		// Empty table of capacity slots, keeps mSize
+		void Allocate(usize capacity)
+		{
+			mCapacity = capacity;
+			mControl = (ControlByte*)::operator new(capacity, std::align_val_t(GroupSize));
+			memset(mControl, Empty, capacity);
+			mSlots = std::allocator<value_type>().allocate(capacity);
+			mGrowthLeft = MaxLoad(capacity);
+		}
+
+		static void Free(ControlByte* control, value_type* slots, usize capacity)
+		{
+			if (capacity == 0)
+				return;
+			::operator delete(control, std::align_val_t(GroupSize));
+			std::allocator<value_type>().deallocate(slots, capacity);
+		}
+
+		void DestroySlots()
+		{
+			if constexpr (!std::is_trivially_destructible_v<value_type>)
+			{
+				for (usize i = 0; i < mCapacity; i++)
+				{
+					if (mControl[i] >= 0)
+						mSlots[i].~value_type();
+				}
+			}
+		}
+
+		void Release()
+		{
+			DestroySlots();
+			Free(mControl, mSlots, mCapacity);
+			mControl = nullptr;
+			mSlots = nullptr;
+			mCapacity = 0;
+			mSize = 0;
+			mGrowthLeft = 0;
+		}
+
+		// Same capacity and slot positions, so no rehashing
+		void CopyFrom(const FlatHashMap& other)
+		{
+			if (other.mCapacity == 0)
+				return;
+
+			Allocate(other.mCapacity);
+			memcpy(mControl, other.mControl, mCapacity);
+			for (usize i = 0; i < mCapacity; i++)
+			{
+				if (mControl[i] >= 0)
+					new(&mSlots[i]) value_type(other.mSlots[i]);
+			}
+			mSize = other.mSize;
+			mGrowthLeft = other.mGrowthLeft;
+		}
+
+		void Swap(FlatHashMap& other)
+		{
+			std::swap(mControl, other.mControl);
+			std::swap(mSlots, other.mSlots);
+			std::swap(mCapacity, other.mCapacity);
+			std::swap(mSize, other.mSize);
+			std::swap(mGrowthLeft, other.mGrowthLeft);
+		}
+
+	private:
+		ControlByte* mControl = nullptr;
+		value_type* mSlots = nullptr;
+		usize mCapacity = 0;
+		usize mSize = 0;
+		// Inserts into empty slots left before the table has to grow
+		usize mGrowthLeft = 0;
+	};
+
+	// Map keyed by UUID, hashed on the UUID bits
+	template<typename V>
+	using UUIDMap = FlatHashMap<UUID, V, UUIDHash>;
+}
+
+#endif
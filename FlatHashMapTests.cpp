@@ -0,0 +1,127 @@
+#include "FlatHashMap.h"
+#include "Testing.h"
+
+#include <string>
+#include <unordered_map>
+
+using namespace Steve;
+
+namespace
+{
+	// Puts every key in one of four probe sequences, so lookups have to walk past tombstones
+	struct CollidingHash
+	{
+		u64 operator()(u32 key) const { return key % 4; }
+	};
+
+	static_assert(std::is_const_v<FlatHashMap<u32, u32>::value_type::first_type>, "Keys cannot be changed through an iterator");
+
+	void Tombstones()
+	{
+		FlatHashMap<u32, u32, CollidingHash> map;
+		for (u32 i = 0; i < 256; i++)
+			map.emplace(i, i * 10);
+
+		for (u32 i = 0; i < 256; i += 2)
+			CHECK(map.erase(i) == 1);
+		CHECK(map.size() == 128);
+
+		// Erased slots are in the middle of the probe sequences of the keys that are left
+		for (u32 i = 1; i < 256; i += 2)
+		{
+			CHECK(map.contains(i));
+			CHECK(map.at(i) == i * 10);
+		}
+		for (u32 i = 0; i < 256; i += 2)
+			CHECK(!map.contains(i));
+
+		// Reinserting fills tombstones and does not duplicate keys
+		for (u32 i = 0; i < 256; i++)
+			map.emplace(i, i);
+		CHECK(map.size() == 256);
+		CHECK(!map.emplace(7, 0).second);
+
+		// Erase and insert churn at a steady size, tombstones must not pile up into a full table
+		for (u32 round = 0; round < 64; round++)
+		{
+			for (u32 i = 0; i < 256; i++)
+				map.erase(i + round * 256);
+			for (u32 i = 0; i < 256; i++)
+				map.emplace(i + (round + 1) * 256, i);
+			CHECK(map.size() == 256);
+		}
+		for (u32 i = 0; i < 256; i++)
+			CHECK(map.contains(i + 64 * 256));
+	}
+
+	void Rehash()
+	{
+		FlatHashMap<u32, std::string> map;
+		std::unordered_map<u32, std::string> reference;
+		for (u32 i = 0; i < 10000; i++)
+		{
+			// Longer than the small string buffer, so a bitwise move would be caught by the sanitizers
+			std::string value = "value number " + std::to_string(i) + " with a heap buffer";
+			map.emplace(i * 7919, value);
+			reference.emplace(i * 7919, std::move(value));
+		}
+
+		CHECK(map.size() == reference.size());
+		for (const auto& [key, value] : reference)
+		{
+			const auto it = map.find(key);
+			CHECK(it != map.end() && it->second == value);
+		}
+
+		usize visited = 0;
+		for (const auto& [key, value] : map)
+		{
+			CHECK(reference.at(key) == value);
+			visited++;
+		}
+		CHECK(visited == map.size());
+
+		// A copy keeps the slot positions, a reserve rehashes into a bigger table
+		FlatHashMap<u32, std::string> copy = map;
+		copy.reserve(50000);
+		for (const auto& [key, value] : reference)
+			CHECK(copy.at(key) == value);
+	}
+
+	void EraseDuringIteration()
+	{
+		FlatHashMap<u32, u32> map;
+		for (u32 i = 0; i < 1000; i++)
+			map.emplace(i, i);
+
+		for (auto it = map.begin(); it != map.end();)
+		{
+			if (it->first % 3 == 0)
+				it = map.erase(it);
+			else
+				++it;
+		}
+
+		CHECK(map.size() == 666);
+		usize visited = 0;
+		for (const auto& [key, value] : map)
+		{
+			CHECK(key % 3 != 0);
+			CHECK(key == value);
+			visited++;
+		}
+		CHECK(visited == 666);
+
+		map.clear();
+		CHECK(map.empty());
+		CHECK(map.begin() == map.end());
+	}
+}
+
+int main()
+{
+	Tombstones();
+	Rehash();
+	EraseDuringIteration();
+	return Steve::Testing::Result();
+}
@@ -12,8 +12,9 @@
 #include "RegistryData.h"
 #include "View.h"
 
+#include <functional>
+#include <memory>
 #include <tuple>
-#include <typeindex>
 #include <vector>
 
 namespace Steve
@@ -21,15 +22,25 @@ namespace Steve
 	class IGroup
 	{
 	public:
+		virtual ~IGroup() = default;
+
 		virtual void SetAll() = 0;
 		virtual void InsertNew(Entity& entity) = 0;
-		virtual void Move(Entity& entity, u8* location) = 0;
+		// Takes entity out of the group, relocate moves every component to its new storage
+		virtual void Remove(const UUID& entity, const std::function<void(IHandle*)>& relocate) = 0;
+		// Copy of the group for a cloned registry, handles must already be cloned
+		virtual std::unique_ptr<IGroup> Clone(RegistryData* reg_data, const HandleRemap& handle_remap) const = 0;
+		// Copy on write of the group storage for snapshots
+		virtual std::shared_ptr<const u8> Share() const = 0;
+		virtual void Unshare() = 0;
 	};
 
 
 	template<typename ...Ts>
 	class Group : public IGroup
 	{
+		static_assert((!TagComponent<Ts> && ...), "Tags have no data to group");
+		static_assert((!SharedComponent<Ts> && ...), "Shared values belong to several entities and cannot be grouped");
 		using TupleType = std::tuple<Ts...>;
 
 	public:
@@ -38,18 +49,7 @@ namespace Steve
 			CH_PROFILE_FUNCTION();
 
 			mRegData = reg_data;
-			// pType = std::type_index(typeid(Group<Ts...>));
-
-			int i = 0;
-			([&]()
-				{
-					std::type_index type = std::type_index(typeid(Ts));
-					for (int x = 0; x < i; x++)
-					{
-						CORE_ASSERT(mComponentTypes[x] != type, "Group cannot have multiple of the same type")
-					}
-					mComponentTypes[i++] = std::type_index(typeid(Ts));
-				}, ...);
+			CORE_ASSERT(MakeSignature<Ts...>().count() == sizeof...(Ts), "Group cannot have multiple of the same type")
 		}
 		
 		~Group() 
@@ -60,9 +60,10 @@ namespace Steve
 		{
 			CH_PROFILE_FUNCTION();
 
-			View<Ts...> view;
-			for (std::tuple<Handle<Ts>&...>& tup : view) {
-				std::apply(mStorage.Insert, tup);
+			for (Entity& entity : mRegData->Entities)
+			{
+				if (entity.ContainsAll<Ts...>())
+					InsertNew(entity);
 			}
 		}
 
@@ -71,18 +72,31 @@ namespace Steve
 			CH_PROFILE_FUNCTION();
 
 			CORE_ASSERT(entity.ContainsAll<Ts...>(), "Entity does not contain all elements")
-			std::apply(mStorage.Insert, entity.GetComponents<Ts...>());
+			std::apply([&](auto&... handles) { mStorage.Insert(entity.Id, handles...); }, entity.GetComponents<Ts...>());
+		}
+
+		void Remove(const UUID& entity, const std::function<void(IHandle*)>& relocate) override
+		{
+			mStorage.Remove(entity, relocate);
+		}
+
+		std::unique_ptr<IGroup> Clone(RegistryData* reg_data, const HandleRemap& handle_remap) const override
+		{
+			CH_PROFILE_FUNCTION();
+
+			std::unique_ptr<Group> group = std::make_unique<Group>(reg_data);
+			group->mStorage.CloneFrom(mStorage, handle_remap);
+			return group;
+		}
+
+		std::shared_ptr<const u8> Share() const override
+		{
+			return mStorage.Share();
 		}
 
-		void Move(Entity& entity, u8* location) override
+		void Unshare() override
 		{
-			u8* ptr = location;
-			ApplyTuple(entity.GetComponents<Ts...>(), [&](auto& handle)
-				{
-					handle.Move(ptr);
-					ptr += handle.Size;
-					mStorage.Remove(handle.Id);
-				});
+			mStorage.Unshare();
 		}
 
 		[[nodiscard]] const u8* GetRaw() const 
@@ -92,7 +106,6 @@ namespace Steve
 	private:
 		RegistryData* mRegData;
 
-		const std::type_index mComponentTypes[sizeof...(Ts)];
 		TupleComponentContainer<Ts...> mStorage;
 	};
 
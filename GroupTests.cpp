@@ -0,0 +1,205 @@
+#include "Registry.h"
+#include "Entity.h"
+#include "Testing.h"
+
+#include <string>
+
+namespace Steve
+{
+	namespace
+	{
+		struct Position
+		{
+			f32 X;
+		};
+
+		// Not trivially copyable, has to be relocated when the group storage grows
+		struct Name
+		{
+			std::string Value;
+		};
+
+		// Counts live instances, every construction has to be matched by a destruction
+		struct Counted
+		{
+			static inline i32 Alive = 0;
+
+			Counted() { Alive++; }
+			Counted(const Counted&) { Alive++; }
+			Counted(Counted&&) noexcept { Alive++; }
+			~Counted() { Alive--; }
+
+			i32 Value = 0;
+		};
+
+		// Grouped components are stored next to each other, padded to the alignment of the tuple
+		bool IsGrouped(Entity& entity)
+		{
+			const u8* position = (const u8*)entity.GetComponent<const Position>().Component;
+			const u8* name = (const u8*)entity.GetComponent<const Name>().Component;
+			return name == position + TupleComponentContainer<Position, Name>::PaddedSize(sizeof(Position));
+		}
+	}
+
+	// Friend of Registry, which is otherwise only reachable through Scene
+	class RegistryTests
+	{
+	public:
+		// Entities that already have every type move into the group, the others stay in the rest storage
+		static void GroupExisting()
+		{
+			Registry registry;
+			const UUID both = registry.CreateEntity();
+			const UUID single = registry.CreateEntity();
+			registry.GetEntity(both).AddComponent(Position{ 1.0f });
+			registry.GetEntity(both).AddComponent(Name{ "a name longer than the small string buffer" });
+			registry.GetEntity(single).AddComponent(Position{ 2.0f });
+
+			registry.GroupComponents<Position, Name>();
+
+			CHECK(registry.mGroups.size() == 1);
+			CHECK(registry.IsInGroup(GetComponentId<Position>()).has_value());
+			CHECK(IsGrouped(registry.GetEntity(both)));
+			CHECK(registry.GetEntity(both).GetComponent<const Position>()->X == 1.0f);
+			CHECK(registry.GetEntity(both).GetComponent<const Name>()->Value == "a name longer than the small string buffer");
+			CHECK(registry.GetEntity(single).GetComponent<const Position>()->X == 2.0f);
+		}
+
+		// Completing the set joins the group, removing one of the types leaves it with the other component intact
+		static void AddAndRemove()
+		{
+			Registry registry;
+			registry.GroupComponents<Position, Name>();
+
+			const UUID first = registry.CreateEntity();
+			registry.GetEntity(first).AddComponent(Position{ 1.0f });
+			registry.GetEntity(first).AddComponent(Name{ "joins the group once both are there" });
+			CHECK(IsGrouped(registry.GetEntity(first)));
+
+			registry.GetEntity(first).RemoveComponents<Name>();
+			CHECK(!registry.GetEntity(first).Contains<Name>());
+			CHECK(registry.GetEntity(first).GetComponent<const Position>()->X == 1.0f);
+
+			registry.GetEntity(first).AddComponent(Name{ "and joins again" });
+			CHECK(IsGrouped(registry.GetEntity(first)));
+			CHECK(registry.GetEntity(first).GetComponent<const Name>()->Value == "and joins again");
+		}
+
+		// Destroyed entities leave the group, the ones that stay keep their values
+		static void Destroy()
+		{
+			Registry registry;
+			registry.GroupComponents<Position, Name>();
+
+			const UUID first = registry.CreateEntity();
+			const UUID second = registry.CreateEntity();
+			for (const UUID& id : { first, second })
+			{
+				registry.GetEntity(id).AddComponent(Position{ id == first ? 1.0f : 2.0f });
+				registry.GetEntity(id).AddComponent(Name{ id == first ? "first" : "second" });
+			}
+
+			registry.MarkForDestroy(first);
+			registry.Flush();
+
+			CHECK(!registry.mData.EntityIndices.contains(first));
+			CHECK(IsGrouped(registry.GetEntity(second)));
+			CHECK(registry.GetEntity(second).GetComponent<const Position>()->X == 2.0f);
+			CHECK(registry.GetEntity(second).GetComponent<const Name>()->Value == "second");
+		}
+
+		// Growing the group storage moves every tuple already in it
+		static void Growth()
+		{
+			Registry registry;
+			registry.GroupComponents<Position, Name>();
+
+			std::vector<UUID> entities;
+			for (u32 i = 0; i < 500; i++)
+			{
+				entities.push_back(registry.CreateEntity());
+				registry.GetEntity(entities.back()).AddComponent(Position{ (f32)i });
+				registry.GetEntity(entities.back()).AddComponent(Name{ "entity with a long enough name " + std::to_string(i) });
+			}
+
+			bool valid = true;
+			for (u32 i = 0; i < entities.size(); i++)
+			{
+				Entity& entity = registry.GetEntity(entities[i]);
+				valid = valid && IsGrouped(entity);
+				valid = valid && entity.GetComponent<const Position>()->X == (f32)i;
+				valid = valid && entity.GetComponent<const Name>()->Value == "entity with a long enough name " + std::to_string(i);
+			}
+			CHECK(valid);
+		}
+
+		// Entities that keep joining and leaving the group reuse its storage instead of growing it
+		static void Churn()
+		{
+			Registry registry;
+			registry.GroupComponents<Position, Name>();
+
+			std::vector<UUID> entities;
+			for (u32 i = 0; i < 10; i++)
+			{
+				entities.push_back(registry.CreateEntity());
+				registry.GetEntity(entities.back()).AddComponent(Position{ (f32)i });
+			}
+			registry.GetEntity(entities.front()).AddComponent(Name{ "stays in the group the whole time" });
+
+			for (u32 round = 0; round < 1000; round++)
+			{
+				for (u32 i = 1; i < entities.size(); i++)
+					registry.GetEntity(entities[i]).AddComponent(Name{ "joins and leaves every round" });
+				for (u32 i = 1; i < entities.size(); i++)
+					registry.GetEntity(entities[i]).RemoveComponents<Name>();
+			}
+			for (u32 i = 1; i < entities.size(); i++)
+				registry.GetEntity(entities[i]).AddComponent(Name{ "joins and leaves every round" });
+
+			using Storage = TupleComponentContainer<Position, Name>;
+			const u8* storage = dynamic_cast<const Group<Position, Name>&>(*registry.mGroups.begin()->second).GetRaw();
+			bool bounded = true;
+			bool valid = true;
+			for (u32 i = 0; i < entities.size(); i++)
+			{
+				Entity& entity = registry.GetEntity(entities[i]);
+				const u8* name = (const u8*)entity.GetComponent<const Name>().Component;
+				bounded = bounded && name >= storage && name < storage + 4 * entities.size() * Storage::TotalSize;
+				valid = valid && IsGrouped(entity) && entity.GetComponent<const Position>()->X == (f32)i;
+			}
+			CHECK(bounded);
+			CHECK(valid);
+			CHECK(registry.GetEntity(entities.front()).GetComponent<const Name>()->Value == "stays in the group the whole time");
+		}
+
+		// The registry destroys what is left, in the group and in the rest storage
+		static void DestroyWithRegistry()
+		{
+			{
+				Registry registry;
+				registry.GroupComponents<Position, Counted>();
+				for (u32 i = 0; i < 100; i++)
+				{
+					Entity& entity = registry.GetEntity(registry.CreateEntity());
+					entity.AddComponent(Counted());
+					if (i % 2 == 0)
+						entity.AddComponent(Position{ (f32)i });
+				}
+				CHECK(Counted::Alive == 100);
+			}
+			CHECK(Counted::Alive == 0);
+		}
+	};
+}
+
+int main()
+{
+	Steve::RegistryTests::GroupExisting();
+	Steve::RegistryTests::AddAndRemove();
+	Steve::RegistryTests::Destroy();
+	Steve::RegistryTests::Growth();
+	Steve::RegistryTests::Churn();
+	Steve::RegistryTests::DestroyWithRegistry();
+	return Steve::Testing::Result();
+}
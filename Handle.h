@@ -2,14 +2,21 @@
 #define __HANDLE_HEADER__ 
 
 #include "ComponentType.h"
+#include "ComponentInfo.h"
 
+#include <tuple>
 #include <typeindex>
+#include <unordered_map>
+#include <vector>
 
 namespace Steve
 {
 
+	// Not virtual, Handle<T> only adds typed accessors that can be inlined
 	class IHandle {
+		friend class ComponentIndex;
 		friend class Entity;
+		friend class Registry;
 	public:
 		// Copy constructor
 		IHandle(const IHandle& handle) = default;
@@ -18,94 +25,83 @@ namespace Steve
 		IHandle(IHandle&& comp) = default;
 
 		// Constructor
-		IHandle(std::type_index type, usize size, const UUID& id = UUID()) : Type(type), Id(id), Size(size) { mOwners.reserve(3); }
+		IHandle(const ComponentTypeInfo& info, const UUID& id = UUID()) : Type(info.Type), Id(id), Size(info.Size), Info(&info) {}
 
-		// Destructor IMPORTANT!
-		virtual ~IHandle() = default;
+		~IHandle() = default;
 
 		// Less operator for indexing in hash table
 		friend bool operator<(const IHandle& l, const IHandle& r)
 		{
-			return l.Component->p_Id < r.Component->p_Id;
+			return l.Id < r.Id;
 		}
 
-		// Deref
-		virtual ComponentType& operator->() {
-			return *Component;
-		}
-
-		virtual ComponentType& operator*() {
-			return *Component;
-		}
-
-		[[nodiscard]] virtual ComponentType* GetComponent() { return Component; }
+		[[nodiscard]] u8* GetComponent() const { return Component; }
 
+		// Relocates the component, its old place is left destroyed
 		void Move(u8* location)
 		{
 			if (Component != nullptr)
 			{
-				memcpy_s(location, Size, Component, Size);
-				Component = (ComponentType*)location;
+				RelocateComponent(*Info, location, Component);
+				Component = location;
 			}
 		}
 		void SetLocation(u8* new_location)
 		{
-			Component = (ComponentType*)new_location;
+			Component = new_location;
 		}
 
 	public:
 		const std::type_index Type;
 		const UUID Id;
-		ComponentType* Component = nullptr;
+		u8* Component = nullptr;
 		const usize Size;
-
+		const ComponentTypeInfo* Info;
 
 	// Private stuff for Registry
 	private:
-		// UUID's of entities
-		std::vector<const UUID&> mOwners;
+		// Indices of the entities that have this component, more than one for shared values
+		// Kept by ComponentIndex
+		std::vector<u32> mOwners;
 	};
 
+	// Same layout as IHandle, so an IHandle* of the right type can be cast to it
 	template<typename T>
 	class Handle final : public IHandle
 	{
 	public:
-		T& operator->() override
+		T* operator->()
 		{
-			return *(T*)Component;
+			return (T*)Component;
 		}
 	
-		T& operator*() override
+		T& operator*()
 		{
 			return *(T*)Component;
 		}
 
-		~Handle() override
-		{
-		}
-
 		// Initializes base class
-		Handle(const UUID id = UUID()) : IHandle(std::type_index(typeid(T)), sizeof(T), id) {}
+		Handle(const UUID id = UUID()) : IHandle(GetComponentTypeInfo<T>(), id) {}
 
 		Handle(T& e) : Handle()
         {
-            Component = e;
+            Component = (u8*)&e;
         }
 
 		Handle(T* e) : Handle()
 		{
-			Component = e;
+			Component = (u8*)e;
 		}
 
 		Handle(void* location, T&& e, const UUID id = UUID()) : Handle(id)
 		{
-			Component = new(location) T(e);
+			Component = (u8*)new(location) T(std::move(e));
 		}
 
 		template<typename ...Args>
 		Handle(void* location, Args&& ...args) : Handle()
 		{
-			Component = new(location) T(std::forward<Args>(args)...);
+			Component = (u8*)new(location) T(std::forward<Args>(args)...);
 		}
 
 		T* Get()
@@ -114,6 +110,27 @@ namespace Steve
 		}
 	};
 
+	// Original handle -> handle in the cloned registry
+	using HandleRemap = std::unordered_map<const IHandle*, IHandle*>;
+
+	// std::tuple<Handle<Ts>&...> without the tags, they have nothing to reference
+	template<typename ...Ts>
+	struct HandleTuple
+	{
+		using type = std::tuple<>;
+	};
+
+	template<typename T, typename ...Ts>
+	struct HandleTuple<T, Ts...>
+	{
+		using type = decltype(std::tuple_cat(
+			std::declval<std::conditional_t<TagComponent<T>, std::tuple<>, std::tuple<Handle<T>&>>>(),
+			std::declval<typename HandleTuple<Ts...>::type>()));
+	};
+
+	template<typename ...Ts>
+	using HandleTuple_t = typename HandleTuple<Ts...>::type;
+
 	template<typename I>
 	struct RemoveHandle
 	{
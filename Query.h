@@ -0,0 +1,85 @@
+#ifndef QUERY_HEADER_
+#define QUERY_HEADER_
+
+#include "Steve/Core/Core.h"
+
+#include "ComponentInfo.h"
+#include "Containers.h"
+
+#include <vector>
+
+namespace Steve
+{
+	// Compile time query terms for View, a bare component type is the same as Include<T>
+	// Include: entity needs all of them, the view yields Handle<T>&
+	// Exclude: entity needs none of them, nothing is yielded
+	// Optional: not matched on, the view yields Handle<T>* which is nullptr if missing
+	// AnyOf: entity needs at least one of them, the view yields Handle<T>*
+	template<typename ...Ts> struct Include {};
+	template<typename ...Ts> struct Exclude {};
+	template<typename ...Ts> struct Optional {};
+	template<typename ...Ts> struct AnyOf {};
+
+	// Tag set by Registry::MarkForDestroy, every view excludes it unless it asks for it
+	struct PendingDestroy {};
+
+	struct QueryMasks
+	{
+		Signature Include;
+		Signature Exclude;
+		Signature AnyOf;
+		// Not part of the query, the types a view can write to
+		Signature Write;
+		// Not part of the query either, the types a view fetches if they are there
+		Signature Optional;
+	};
+
+	// Persistent list of the entities that have all of include, none of exclude and one of any_of (if set)
+	// Owned by the Registry, which updates it whenever one of those components is added or removed
+	class Query
+	{
+	public:
+		Query(const QueryMasks& masks) : mInclude(masks.Include), mExclude(masks.Exclude), mAnyOf(masks.AnyOf) {}
+
+		// Only mask tests, no per entity callbacks
+		[[nodiscard]] bool Matches(const Signature& signature) const
+		{
+			return (signature & mInclude) == mInclude
+				&& (signature & mExclude).none()
+				&& (mAnyOf.none() || (signature & mAnyOf).any());
+		}
+
+		// Called by the Registry when the signature of an entity changed
+		void Update(u32 entity_index, const Signature& signature)
+		{
+			if (Matches(signature))
+				mEntities.Insert(entity_index);
+			else
+				mEntities.Remove(entity_index);
+		}
+
+		void Remove(u32 entity_index) { mEntities.Remove(entity_index); }
+
+		[[nodiscard]] bool Contains(u32 entity_index) const { return mEntities.Contains(entity_index); }
+
+		// Dense list of entity indices, order changes when entities leave the query
+		[[nodiscard]] const std::vector<u32>& GetEntities() const { return mEntities.GetEntities(); }
+		[[nodiscard]] usize GetSize() const { return mEntities.GetSize(); }
+
+		[[nodiscard]] const Signature& GetInclude() const { return mInclude; }
+		[[nodiscard]] const Signature& GetExclude() const { return mExclude; }
+		[[nodiscard]] const Signature& GetAnyOf() const { return mAnyOf; }
+
+		// Every type that can change the result
+		[[nodiscard]] Signature GetTypes() const { return mInclude | mExclude | mAnyOf; }
+
+	private:
+		const Signature mInclude;
+		const Signature mExclude;
+		const Signature mAnyOf;
+
+		EntitySet mEntities;
+	};
+}
+
+#endif
@@ -3,82 +3,1171 @@
 #include "Entity.h"
 #include "Steve/Core/KeyCodes.h"
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <ranges>
+
 namespace Steve
 {
 
-	UUID Registry::CreateEntity(const char* name)
+	UUID Registry::CreateEntity()
 	{
-		Entity ent(name);
-		mData.Entities.emplace(ent.Id, ent);
-		return ent.Id;
+		return EmplaceEntity().Id;
 	}
 
 	Entity& Registry::GetEntity(const UUID& uuid)
 	{
-		return mData.Entities[uuid];
+		CORE_ASSERT(mData.EntityIndices.contains(uuid), "Entity does not exist")
+		return mData.Entities[mData.EntityIndices.at(uuid)];
+	}
+
+	// The index of an entity never changes
+	Entity& Registry::EmplaceEntity()
+	{
+		return MaterializeEntity(mEntityAllocator.Reserve(), UUID());
+	}
+
+	// Turns a reserved index into a live record, placeholders fill the gap if
+	// other threads reserved lower indices that are not merged yet
+	Entity& Registry::MaterializeEntity(const u32 index, const UUID& id)
+	{
+		while (mData.Entities.size() <= index)
+			mData.Entities.emplace_back(this, InvalidIndex);
+
+		Entity& entity = mData.Entities[index];
+		std::destroy_at(&entity);
+		std::construct_at(&entity, this, index, id);
+		mData.EntityIndices.emplace(id, index);
+
+		for (Query* query : mUnfilteredQueries)
+			query->Update(index, entity.mSignature);
+
+		if (mRecorder != nullptr)
+			mRecorder->CreateEntity(index);
+
+		return entity;
+	}
+
+	StagingBuffer& Registry::CreateStagingBuffer()
+	{
+		std::scoped_lock lock(mStagingMutex);
+		return *mStagingBuffers.emplace_back(std::make_unique<StagingBuffer>(&mEntityAllocator));
 	}
 
 	/**
-	 * \brief Checks if type is already in group
-	 * \param type Type_index object
-	 * \return Returns an iterator to the std::pair of the found type, if it
-	 * hasnt found it, it will point to mGrouptypes end()
+	 * \brief Moves the entities and components of all staging buffers into the
+	 * registry. Entities are created first, so components can target entities of
+	 * any buffer
 	 */
-	std::optional<const UUID&> Registry::IsInGroup(const std::type_index type)
+	void Registry::MergeStaging()
 	{
-		auto it = mGroupTypes.begin();
-		for(; it != mGroupTypes.end(); ++it)
+		CH_PROFILE_FUNCTION();
+		std::scoped_lock lock(mStagingMutex);
+
+		// In index order, so fresh indices are appended instead of going through placeholders
+		std::vector<StagingBuffer::StagedEntity> entities;
+		for (const std::unique_ptr<StagingBuffer>& buffer : mStagingBuffers)
+			entities.insert(entities.end(), buffer->mEntities.begin(), buffer->mEntities.end());
+
+		std::ranges::sort(entities, {}, &StagingBuffer::StagedEntity::Index);
+		for (const StagingBuffer::StagedEntity& staged : entities)
+			MaterializeEntity(staged.Index, staged.Id);
+
+		// Grouped by entity so each entity gets all of its staged components in one attach
+		using StagedPair = std::pair<u32, const StagingBuffer::StagedComponent*>;
+		std::vector<StagedPair> components;
+		for (const std::unique_ptr<StagingBuffer>& buffer : mStagingBuffers)
 		{
-			auto it2 = it->second.begin();
-			for(; it2 != it->second.end(); ++it2)
+			for (const StagingBuffer::StagedComponent& staged : buffer->mComponents)
+				components.emplace_back(GetEntity(staged.Entity).mIndex, &staged);
+		}
+		std::ranges::stable_sort(components, {}, &StagedPair::first);
+
+		std::vector<IHandle*> handles;
+		for (usize begin = 0, end = 0; begin < components.size(); begin = end)
+		{
+			Entity& entity = GetEntity(components[begin].first);
+			handles.clear();
+			Signature tags;
+			for (end = begin; end < components.size() && components[end].first == entity.mIndex; end++)
 			{
-				if (*it2 == type)
-					return it->first;
+				const ComponentTypeInfo& info = *components[end].second->Info;
+				u8* source = components[end].second->Data;
+				if (info.Tag)
+				{
+					tags.set(info.Index);
+					continue;
+				}
+
+				if (info.Hash != nullptr)
+				{
+					handles.push_back(StoreShared(info, source));
+				}
+				else
+				{
+					IHandle* new_handle = AllocateComponent(info);
+					info.MoveConstruct(new_handle->Component, source);
+					handles.push_back(new_handle);
+				}
+
+				if (info.Destroy != nullptr)
+					info.Destroy(source);
 			}
+
+			// A tag can be staged for an entity that already has it
+			AttachComponents(&entity, handles, tags & ~entity.mSignature);
+		}
+
+		for (const std::unique_ptr<StagingBuffer>& buffer : mStagingBuffers)
+			buffer->Clear();
+	}
+
+	/**
+	 * \brief Gets the cached query for the masks. The first call matches all
+	 * entities, after that the query is updated on every add and remove
+	 * \param masks Include, exclude and any of signatures
+	 */
+	Query& Registry::GetQuery(const QueryMasks& masks)
+	{
+		if (Query* query = FindQuery(masks))
+			return *query;
+
+		CH_PROFILE_FUNCTION();
+		const std::tuple<u64, u64, u64> key(masks.Include.to_ullong(), masks.Exclude.to_ullong(), masks.AnyOf.to_ullong());
+		Query* query = mQueries.emplace(key, std::make_unique<Query>(masks)).first->second.get();
+		RegisterQuery(query);
+
+		for (const Entity& entity : mData.Entities)
+		{
+			if (entity.IsAlive())
+				query->Update(entity.mIndex, entity.mSignature);
+		}
+
+		return *query;
+	}
+
+	Query* Registry::FindQuery(const QueryMasks& masks)
+	{
+		static_assert(MaxComponentTypes <= 64, "Query key packs a signature in a u64");
+
+		const auto it = mQueries.find({ masks.Include.to_ullong(), masks.Exclude.to_ullong(), masks.AnyOf.to_ullong() });
+		return it != mQueries.end() ? it->second.get() : nullptr;
+	}
+
+	void Registry::RegisterQuery(Query* query)
+	{
+		const Signature types = query->GetTypes();
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (types.test(id))
+				mComponentQueries[id].push_back(query);
+		}
+
+		if (query->GetInclude().none())
+			mUnfilteredQueries.push_back(query);
+	}
+
+	void Registry::SignatureChanged(const Entity& entity, const ComponentId type)
+	{
+		for (Query* query : mComponentQueries[type])
+			query->Update(entity.mIndex, entity.mSignature);
+		UpdateIndices(entity, type);
+
+		if (mRecorder != nullptr)
+			mRecorder->ComponentsChanged(entity.mIndex, Signature().set(type), entity.mSignature.test(type));
+	}
+
+	void Registry::SignatureChanged(const Entity& entity, const Signature& types)
+	{
+		// Batches either add or remove all of types
+		if (mRecorder != nullptr)
+			mRecorder->ComponentsChanged(entity.mIndex, types, (entity.mSignature & types) == types);
+
+		mChangedQueries.clear();
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (types.test(id))
+				mChangedQueries.insert(mChangedQueries.end(), mComponentQueries[id].begin(), mComponentQueries[id].end());
+		}
+
+		std::ranges::sort(mChangedQueries);
+		const auto duplicates = std::ranges::unique(mChangedQueries);
+		mChangedQueries.erase(duplicates.begin(), duplicates.end());
+		for (Query* query : mChangedQueries)
+			query->Update(entity.mIndex, entity.mSignature);
+
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (types.test(id))
+				UpdateIndices(entity, id);
+		}
+	}
+
+	void Registry::UpdateIndices(const Entity& entity, const ComponentId type)
+	{
+		// The spatial index follows the indexed component
+		if (mSpatialIndex != nullptr && type == mSpatialType)
+		{
+			if (entity.mSignature.test(type))
+				mSpatialIndex->Insert(entity.mIndex, mSpatialBounds(mData.ComponentIndices[type].Get(entity.mIndex)->Component));
+			else
+				mSpatialIndex->Remove(entity.mIndex);
+		}
+
+		// Cells count the bytes of their components against the memory budget
+		const ComponentTypeInfo& info = *ComponentTypeTable()[type];
+		if (mPartition != nullptr && !info.Tag)
+			mPartition->ComponentChanged(entity.mIndex, info.Size, entity.mSignature.test(type));
+	}
+
+	void Registry::BuildSpatialIndex(const f32 cell_size)
+	{
+		CH_PROFILE_FUNCTION();
+		mSpatialIndex = std::make_unique<SpatialGrid>(cell_size);
+
+		const ComponentIndex& index = mData.ComponentIndices[mSpatialType];
+		for (usize i = 0; i < index.GetSize(); i++)
+			mSpatialIndex->Insert(index.GetEntities()[i], mSpatialBounds(index.GetHandles()[i]->Component));
+	}
+
+	/**
+	 * \brief Reads the bounds of every indexed entity, only entities that moved
+	 * to other cells touch the grid
+	 */
+	void Registry::UpdateSpatialIndex()
+	{
+		CH_PROFILE_FUNCTION();
+		if (!HasSpatialIndex())
+			return;
+
+		const ComponentIndex& index = mData.ComponentIndices[mSpatialType];
+		for (usize i = 0; i < index.GetSize(); i++)
+			mSpatialIndex->Update(index.GetEntities()[i], mSpatialBounds(index.GetHandles()[i]->Component));
+	}
+
+	bool Registry::HasSpatialIndex() const
+	{
+		if (mSpatialIndex != nullptr)
+			return true;
+
+		CORE_ERROR("Spatial index is not enabled, see EnableSpatialIndex");
+		CORE_ASSERT(false, "Spatial index is not enabled")
+		return false;
+	}
+
+	/**
+	 * \brief Checks if type is already in group
+	 * \param type Component id
+	 * \return Returns the id of the group that contains the type, empty if
+	 * it is not in any group
+	 */
+	std::optional<UUID> Registry::IsInGroup(const ComponentId type)
+	{
+		for (const auto& [id, types] : mGroupTypes)
+		{
+			if (types.test(type))
+				return id;
 		}
 		return {};
 	}
 
-	// Takes in temp handle and returns a definite one
-	IHandle* Registry::AddComponent(Entity* entity, IHandle* component_handle)
+	ComponentContainer& Registry::GetRestComponents(const ComponentId type)
+	{
+		std::unique_ptr<ComponentContainer>& container = mData.RestComponents[type];
+		if (container == nullptr)
+			container = std::make_unique<ComponentContainer>();
+		return *container;
+	}
+
+	// New handle with uninitialized space in the rest storage of its type, the caller constructs the component
+	IHandle* Registry::AllocateComponent(const ComponentTypeInfo& info)
+	{
+		CH_PROFILE_FUNCTION();
+		PrepareWrite(info.Index);
+		IHandle* new_handle = mData.HandlePool.Create(info);
+		mData.ComponentHandles.emplace(new_handle->Id, new_handle);
+		GetRestComponents(info.Index).Allocate(new_handle);
+		return new_handle;
+	}
+
+	// Hooks a constructed component up to the entity
+	void Registry::AttachComponent(Entity* entity, IHandle* component_handle)
+	{
+		AttachComponents(entity, std::span<IHandle* const>(&component_handle, 1), {});
+	}
+
+	/**
+	 * \brief Adds the handles to the per type indices and applies the final
+	 * signature at once. Groups that the entity completes get it afterwards,
+	 * so every component moves at most once
+	 * \param handles Constructed components, entity becomes an owner
+	 * \param tags Tag types to set
+	 */
+	void Registry::AttachComponents(Entity* entity, const std::span<IHandle* const> handles, const Signature& tags)
+	{
+		CH_PROFILE_FUNCTION();
+		CORE_ASSERT(mData.EntityIndices.contains(entity->Id), "Entity does not exists so component cannot be added")
+
+		Entity& ent = mData.Entities[entity->mIndex];
+		Signature added = tags;
+		for (IHandle* handle : handles)
+		{
+			const ComponentId id = handle->Info->Index;
+			mData.ComponentIndices[id].Insert(ent.mIndex, handle, mData.ChangeTick);
+			added.set(id);
+		}
+
+		CORE_ASSERT((ent.mSignature & added).none(), "Entity already has one of the components")
+		ent.mSignature |= added;
+		SignatureChanged(ent, added);
+
+		for (const auto& [group_id, group_types] : mGroupTypes)
+		{
+			if ((group_types & added).none() || !ent.ContainsAll(group_types))
+				continue;
+
+			// Only drops the bookkeeping, the bytes stay valid until the group has moved them
+			PrepareWrite(group_types);
+			for (ComponentId id = 0; id < MaxComponentTypes; id++)
+			{
+				if (group_types.test(id))
+					GetRestComponents(id).Remove(mData.ComponentIndices[id].Get(ent.mIndex));
+			}
+			mGroups.at(group_id)->InsertNew(ent);
+		}
+	}
+
+	/**
+	 * \brief Takes the handles out of the per type indices and applies the final
+	 * signature at once. Groups the entity leaves hand all of its components
+	 * back to the rest storage in one move
+	 * \param handles Components of entity, freed if entity was their last owner
+	 * \param tags Tag types to clear
+	 */
+	void Registry::DetachComponents(Entity* entity, const std::span<IHandle* const> handles, const Signature& tags)
+	{
+		CH_PROFILE_FUNCTION();
+		Entity& ent = mData.Entities[entity->mIndex];
+		Signature removed = tags;
+		for (const IHandle* handle : handles)
+			removed.set(handle->Info->Index);
+		CORE_ASSERT(ent.ContainsAll(removed), "component not in signature")
+		LeaveGroups(ent, removed);
+
+		for (const IHandle* handle : handles)
+			mData.ComponentIndices[handle->Info->Index].Remove(ent.mIndex);
+
+		ent.mSignature &= ~removed;
+		SignatureChanged(ent, removed);
+
+		for (IHandle* handle : handles)
+		{
+			if (handle->mOwners.empty())
+				FreeComponents(std::span<IHandle* const>(&handle, 1));
+		}
+	}
+
+	void Registry::LeaveGroups(Entity& entity, const Signature& types)
+	{
+		for (const auto& [group_id, group_types] : mGroupTypes)
+		{
+			if ((group_types & types).none() || !entity.ContainsAll(group_types))
+				continue;
+
+			// Removed components go along and are freed from the rest storage
+			PrepareWrite(group_types);
+			mGroups.at(group_id)->Remove(entity.Id, [&](IHandle* handle)
+				{
+					u8* location = handle->Component;
+					GetRestComponents(handle->Info->Index).Allocate(handle);
+					RelocateComponent(*handle->Info, handle->Component, location);
+				});
+		}
+	}
+
+	/**
+	 * \brief Copies every entity, handle and group into a new registry.
+	 * Arenas are copied as a whole, only components that are not trivially
+	 * copyable get copy constructed afterwards
+	 * \return New registry
+	 */
+	std::unique_ptr<Registry> Registry::Clone() const
 	{
 		CH_PROFILE_FUNCTION();
-		CORE_ASSERT(mData.Entities.contains(entity->Id), "Entity does not exists so component cannot be added")
+		std::unique_ptr<Registry> clone(new Registry());
+		RegistryData& data = clone->mData;
+
+		HandleRemap handle_remap;
+		handle_remap.reserve(mData.ComponentHandles.size());
+		data.ComponentHandles.reserve(mData.ComponentHandles.size());
+		for (const auto& [id, handle] : mData.ComponentHandles)
+		{
+			IHandle* new_handle = data.ComponentHandles.emplace(id, data.HandlePool.Create(*handle)).first->second;
+			handle_remap.emplace(handle, new_handle);
+		}
+
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (mData.RestComponents[id] == nullptr)
+				continue;
 
-		// Inserts handle and gets pointer to it
-		IHandle* new_handle = &mData.ComponentHandles.emplace(component_handle->Id, IHandle(component_handle->Type, component_handle->Size)).first->second;
+			data.RestComponents[id] = std::make_unique<ComponentContainer>();
+			data.RestComponents[id]->CloneFrom(*mData.RestComponents[id], handle_remap);
+		}
 
-		Entity& ent = mData.Entities[entity->Id];
-		ent.AddedComponent(new_handle);
+		clone->mGroupTypes = mGroupTypes;
+		for (const auto& [id, group] : mGroups)
+		{
+			clone->mGroups.emplace(id, group->Clone(&data, handle_remap));
+		}
 
-		const std::optional<const UUID&> group_id = IsInGroup(new_handle->Type);
+		// Records are fixed size and keep their index, so hierarchy links stay valid
+		for (const Entity& entity : mData.Entities)
+		{
+			data.Entities.emplace_back(entity).mRegistry = clone.get();
+		}
+		data.EntityIndices = mData.EntityIndices;
+		data.FrontBuffer = mData.FrontBuffer;
+		data.ChangeTick = mData.ChangeTick;
+		clone->mContext.CopyFrom(mContext);
+		clone->mEntityAllocator.CopyFrom(mEntityAllocator);
+		// Marked entities are still alive in the clone, its next Flush destroys them
+		clone->mPendingDestroy = mPendingDestroy;
 
-		// If type not in a group or the entity does not have all types for the group
-		if (!group_id.has_value() || !ent.ContainsAll(mGroupTypes.at(*group_id))) {
-			mData.RestComponents.Insert(new_handle);
-		} else {
-			mGroups.at(*group_id)->InsertNew(*entity);
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			for (const auto& [hash, values] : mData.SharedValues[id])
+			{
+				std::vector<IHandle*>& clones = data.SharedValues[id][hash];
+				for (const IHandle* value : values)
+					clones.push_back(handle_remap.at(value));
+			}
+		}
+
+		data.ComponentIndices = mData.ComponentIndices;
+		for (ComponentIndex& index : data.ComponentIndices)
+		{
+			for (const u32 entity : index.GetEntities())
+			{
+				index.Replace(entity, handle_remap.at(index.Get(entity)));
+			}
 		}
 
+		if (mSpatialIndex != nullptr)
+		{
+			clone->mSpatialIndex = std::make_unique<SpatialGrid>(*mSpatialIndex);
+			clone->mSpatialBounds = mSpatialBounds;
+			clone->mSpatialType = mSpatialType;
+		}
+
+		// Entities keep their index, so the cached results are still valid
+		for (const auto& [key, query] : mQueries)
+		{
+			clone->RegisterQuery(clone->mQueries.emplace(key, std::make_unique<Query>(*query)).first->second.get());
+		}
+
+		return clone;
+	}
+
+	/**
+	 * \brief Takes a copy on write snapshot. Only the entity records and the per
+	 * type indices are copied, the pools are shared and marked so the next write
+	 * to one of them moves the registry to a private copy first
+	 * \return Snapshot that can be handed to other threads
+	 */
+	std::shared_ptr<const RegistrySnapshot> Registry::Snapshot()
+	{
+		CH_PROFILE_FUNCTION();
+		std::shared_ptr<RegistrySnapshot> snapshot = std::make_shared<RegistrySnapshot>();
+
+		snapshot->mEntities.reserve(mData.Entities.size());
+		for (const Entity& entity : mData.Entities)
+		{
+			snapshot->mEntities.push_back({ entity.Id, entity.mIndex, entity.mSignature });
+		}
+		snapshot->mEntityIndices = mData.EntityIndices;
+		snapshot->mFrontBuffer = mData.FrontBuffer;
+
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			const ComponentIndex& index = mData.ComponentIndices[id];
+			if (index.GetSize() == 0)
+				continue;
+
+			RegistrySnapshot::Column& column = snapshot->mColumns[id];
+			column.Info = index.GetHandles().front()->Info;
+			column.Entities = index.GetEntities();
+			column.Data.reserve(index.GetSize());
+
+			if (!column.Info->TriviallyCopyable)
+				column.Owned = std::make_unique<u8[]>(index.GetSize() * column.Info->Size);
+
+			for (usize i = 0; i < index.GetSize(); i++)
+			{
+				column.Insert(column.Entities[i], (u32)i);
+
+				const IHandle* handle = index.GetHandles()[i];
+				if (column.Owned == nullptr)
+				{
+					column.Data.push_back(handle->Component);
+					continue;
+				}
+
+				u8* copy = column.Owned.get() + i * column.Info->Size;
+				column.Info->CopyConstruct(copy, handle->Component);
+				column.Data.push_back(copy);
+			}
+
+			if (column.Owned == nullptr)
+				mData.SharedPools.set(id);
+		}
+
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (mData.SharedPools.test(id) && mData.RestComponents[id] != nullptr)
+				snapshot->mPools.push_back(mData.RestComponents[id]->Share());
+		}
+		for (const auto& [id, group] : mGroups)
+		{
+			if ((mGroupTypes.at(id) & mData.SharedPools).any())
+			{
+				snapshot->mPools.push_back(group->Share());
+				mData.SharedPools |= mGroupTypes.at(id);
+			}
+		}
+
+		return snapshot;
+	}
+
+	/**
+	 * \brief Moves the pools of types (and the groups they are in) to private
+	 * storage if a snapshot still holds them. Pools of dropped snapshots are not
+	 * copied
+	 */
+	void Registry::DetachSnapshots(const Signature& types)
+	{
+		CH_PROFILE_FUNCTION();
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (!types.test(id))
+				continue;
+
+			if (mData.RestComponents[id] != nullptr)
+				mData.RestComponents[id]->Unshare();
+
+			// Group storage is one arena for all of its types
+			if (const std::optional<UUID> group_id = IsInGroup(id))
+			{
+				mGroups.at(*group_id)->Unshare();
+				mData.SharedPools &= ~mGroupTypes.at(*group_id);
+			}
+			mData.SharedPools.reset(id);
+		}
+	}
+
+	/**
+	 * \brief Duplicates prefab together with all of its children
+	 * \param prefab Root entity of the prefab
+	 * \param count Number of copies
+	 * \return Id's of the new root entities
+	 */
+	std::vector<UUID> Registry::Instantiate(const UUID& prefab, const usize count)
+	{
+		CH_PROFILE_FUNCTION();
+		CORE_ASSERT(mData.EntityIndices.contains(prefab), "Prefab entity does not exist")
+
+		std::vector<Entity*> prefab_set;
+		CollectHierarchy(GetEntity(prefab), prefab_set);
+
+		// Position of the parent of every member in prefab_set, parents come before their children
+		std::vector<usize> parents(prefab_set.size(), 0);
+		for (usize e = 1; e < prefab_set.size(); e++)
+		{
+			parents[e] = std::ranges::find(prefab_set, &mData.Entities[prefab_set[e]->mParent]) - prefab_set.begin();
+		}
+
+		usize component_count = 0;
+		for (const Entity* source : prefab_set)
+			component_count += source->mSignature.count();
+
+		mData.EntityIndices.reserve(mData.EntityIndices.size() + count * prefab_set.size());
+		mData.ComponentHandles.reserve(mData.ComponentHandles.size() + count * component_count);
+
+		std::vector<UUID> roots;
+		roots.reserve(count);
+
+		EntityRemap remap;
+		remap.reserve(prefab_set.size());
+		std::vector<Entity*> copies(prefab_set.size());
+		std::vector<IHandle*> handles;
+		for (usize i = 0; i < count; i++)
+		{
+			remap.clear();
+			for (usize e = 0; e < prefab_set.size(); e++)
+			{
+				copies[e] = &EmplaceEntity();
+				remap.emplace(prefab_set[e]->Id, copies[e]->Id);
+			}
+
+			for (usize e = 0; e < prefab_set.size(); e++)
+			{
+				const Entity* source = prefab_set[e];
+				handles.clear();
+				Signature tags;
+				for (ComponentId id = 0; id < MaxComponentTypes; id++)
+				{
+					if (!source->mSignature.test(id))
+						continue;
+
+					// Tags only live in the signature
+					if (mData.ComponentIndices[id].Contains(source->mIndex))
+						handles.push_back(CopyComponent(*mData.ComponentIndices[id].Get(source->mIndex), remap));
+					else
+						tags.set(id);
+				}
+				// The copy is not queued for destroy, a marked prefab must not produce marked copies
+				tags.reset(GetComponentId<PendingDestroy>());
+
+				// One signature change per copy, queries and groups see the finished entity
+				AttachComponents(copies[e], handles, tags);
+			}
+
+			// Children get prepended, so link them in reverse to keep the sibling order
+			for (usize e = prefab_set.size() - 1; e > 0; e--)
+			{
+				copies[parents[e]]->AddChildEntity(copies[e]);
+			}
+
+			roots.push_back(copies[0]->Id);
+		}
+
+		return roots;
+	}
+
+	// Same as AddComponent without attaching, but the data is copied from source
+	// Shared values are not copied, the new entity becomes another owner of the stored value
+	IHandle* Registry::CopyComponent(const IHandle& source, const EntityRemap& remap)
+	{
+		const ComponentTypeInfo& info = *source.Info;
+		if (info.Hash != nullptr)
+			return mData.ComponentHandles.at(source.Id);
+
+		IHandle* new_handle = AllocateComponent(info);
+		if (info.TriviallyCopyable)
+			memcpy_s(new_handle->Component, info.Size, source.Component, info.Size);
+		else
+			info.CopyConstruct(new_handle->Component, source.Component);
+
+		if (info.RemapEntities != nullptr)
+			info.RemapEntities(new_handle->Component, remap);
+
 		return new_handle;
 	}
 
+	// Depth first, root is always the first element
+	void Registry::CollectHierarchy(Entity& root, std::vector<Entity*>& entities)
+	{
+		entities.push_back(&root);
+		root.ForEachChild([&](Entity& child)
+			{
+				CollectHierarchy(child, entities);
+			});
+	}
+
+	/**
+	 * \brief Adds a Shared<T> value to entity. If an equal value is already
+	 * stored, entity becomes one of its owners, otherwise value is moved into
+	 * the rest storage
+	 * \param value Constructed value, the caller still destroys it
+	 * \return Handle of the stored value
+	 */
+	IHandle* Registry::AcquireShared(Entity* entity, const ComponentTypeInfo& info, u8* value)
+	{
+		IHandle* handle = StoreShared(info, value);
+		AttachComponent(entity, handle);
+		return handle;
+	}
+
+	IHandle* Registry::StoreShared(const ComponentTypeInfo& info, u8* value)
+	{
+		CH_PROFILE_FUNCTION();
+		std::vector<IHandle*>& values = mData.SharedValues[info.Index][info.Hash(value)];
+
+		const auto it = std::ranges::find_if(values, [&](const IHandle* handle) { return info.Equal(handle->Component, value); });
+		IHandle* handle = it != values.end() ? *it : nullptr;
+		if (handle == nullptr)
+		{
+			handle = AllocateComponent(info);
+			info.MoveConstruct(handle->Component, value);
+			values.push_back(handle);
+		}
+		return handle;
+	}
+
+	void Registry::ReleaseShared(Entity* entity, IHandle* component_handle)
+	{
+		DetachComponents(entity, std::span<IHandle* const>(&component_handle, 1), {});
+	}
+
+	// The last owner to let go frees it
 	void Registry::DestroyComponent(IHandle* component_handle)
 	{
-		// Not in group
-		if (mData.RestComponents.Contains(component_handle.Id))
+		const std::vector<u32> owners = component_handle->mOwners;
+		if (owners.empty())
 		{
-			mData.RestComponents.Remove(component_handle.Id);
+			FreeComponents(std::span<IHandle* const>(&component_handle, 1));
+			return;
 		}
-		else  // Group
+
+		for (const u32 owner : owners)
+			DetachComponents(&GetEntity(owner), std::span<IHandle* const>(&component_handle, 1), {});
+	}
+
+	/**
+	 * \brief Destroys components that have no owners left and releases their
+	 * storage. The pool removes them in one pass and compacts at most once
+	 * \param component_handles Handles of one component type
+	 */
+	void Registry::FreeComponents(const std::span<IHandle* const> component_handles)
+	{
+		if (component_handles.empty())
+			return;
+
+		const ComponentTypeInfo& info = *component_handles.front()->Info;
+		PrepareWrite(info.Index);
+
+		for (IHandle* handle : component_handles)
 		{
-			auto opt = IsInGroup(component_handle->Type);
-			CORE_ASSERT(opt.has_value(), "Component is nowhere")
+			CORE_ASSERT(handle->Info == &info, "Handles have to be of one type")
+
+			// Hash before the value is destroyed
+			if (info.Hash != nullptr)
+			{
+				auto& shared_values = mData.SharedValues[info.Index];
+				const auto it = shared_values.find(info.Hash(handle->Component));
+				std::erase(it->second, handle);
+				if (it->second.empty())
+					shared_values.erase(it);
+			}
 
-			mData.RestComponents.Insert();
+			if (info.Destroy != nullptr)
+				info.Destroy(handle->Component);
 		}
 
-		mData.ComponentHandles.erase(component_handle.Id);
+		// Components that were grouped are back in the rest storage once their entity left the group
+		GetRestComponents(info.Index).Remove(component_handles);
+
+		for (IHandle* handle : component_handles)
+		{
+			mData.ComponentHandles.erase(handle->Id);
+			mData.HandlePool.Destroy(handle);
+		}
+	}
+
+	void Registry::MarkForDestroy(const UUID& id)
+	{
+		Entity& entity = GetEntity(id);
+		if (entity.IsPendingDestroy())
+			return;
+
+		// One signature change takes it out of every view
+		entity.SetComponentBit(GetComponentId<PendingDestroy>(), true);
+		mPendingDestroy.push_back(entity.mIndex);
+	}
+
+	void Registry::Flush()
+	{
+		if (mPendingDestroy.empty())
+			return;
+
+		CH_PROFILE_FUNCTION();
+		std::ranges::sort(mPendingDestroy);
+		const auto duplicates = std::ranges::unique(mPendingDestroy);
+		mPendingDestroy.erase(duplicates.begin(), duplicates.end());
+
+		// Evicting a cell already destroyed its marked entities, their index may be in use again
+		std::erase_if(mPendingDestroy, [&](const u32 index)
+			{
+				const Entity& entity = mData.Entities[index];
+				return !entity.IsAlive() || !entity.IsPendingDestroy();
+			});
+
+		DestroyEntities(mPendingDestroy);
+		mPendingDestroy.clear();
+	}
+
+	/**
+	 * \brief Destroys a set of entities. Components are removed pool by pool in
+	 * entity order, so every pool is visited once and compacts at most once,
+	 * and queries and indices are updated once per entity
+	 * \param entities Sorted entity indices
+	 */
+	void Registry::DestroyEntities(const std::span<const u32> entities)
+	{
+		CH_PROFILE_FUNCTION();
+		if (mRecorder != nullptr)
+			mRecorder->DestroyEntities(entities);
+
+		for (const u32 index : entities)
+		{
+			Entity& entity = mData.Entities[index];
+			entity.ForEachChild([&](Entity& child)
+				{
+					entity.RemoveChildEntity(&child);
+				});
+			if (entity.mParent != InvalidIndex)
+				mData.Entities[entity.mParent].RemoveChildEntity(&entity);
+
+			LeaveGroups(entity, entity.mSignature);
+		}
+
+		std::vector<IHandle*> freed;
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			ComponentIndex& index = mData.ComponentIndices[id];
+			if (index.GetSize() == 0)
+				continue;
+
+			freed.clear();
+			for (const u32 entity : entities)
+			{
+				if (!index.Contains(entity))
+					continue;
+
+				IHandle* handle = index.Get(entity);
+				index.Remove(entity);
+				// Shared values only go with their last owner
+				if (handle->mOwners.empty())
+					freed.push_back(handle);
+			}
+			FreeComponents(freed);
+		}
+
+		for (const u32 index : entities)
+		{
+			for (const std::unique_ptr<Query>& query : mQueries | std::views::values)
+				query->Remove(index);
+			if (mSpatialIndex != nullptr)
+				mSpatialIndex->Remove(index);
+			if (mPartition != nullptr)
+				mPartition->Unassign(index);
+
+			Entity& entity = mData.Entities[index];
+			mData.EntityIndices.erase(entity.Id);
+			std::destroy_at(&entity);
+			std::construct_at(&entity, this, InvalidIndex);
+		}
+
+		// Reverse, so the lowest index is handed out first again
+		for (const u32 index : entities | std::views::reverse)
+			mEntityAllocator.Release(index);
+	}
+
+	void Registry::StartTrace(const std::filesystem::path& path)
+	{
+		mRecorder = std::make_unique<TraceRecorder>(path);
+		CORE_ASSERT(mRecorder->IsOpen(), "Could not open trace file")
+	}
+
+	void Registry::EnableStreaming(const std::filesystem::path& directory, const usize memory_budget)
+	{
+		CORE_ASSERT(mPartition == nullptr, "Streaming is already enabled")
+		std::filesystem::create_directories(directory);
+		mPartition = std::make_unique<WorldPartition>(directory, memory_budget);
+	}
+
+	void Registry::SetCell(const UUID& id, const CellId cell)
+	{
+		CORE_ASSERT(mPartition != nullptr, "Streaming is not enabled")
+		const Entity& entity = GetEntity(id);
+
+		usize bytes = 0;
+		for (ComponentId type = 0; type < MaxComponentTypes; type++)
+		{
+			if (!entity.mSignature.test(type) || !mData.ComponentIndices[type].Contains(entity.mIndex))
+				continue;
+
+			// Chunks are copied bitwise, anything else would be written as dangling pointers
+			if (!mStreamedTypes.test(type))
+			{
+				CORE_ERROR("Entity is not streamed, component {} was not registered with RegisterStreamedComponents", ComponentTypeTable()[type]->Type.name());
+				return;
+			}
+			bytes += ComponentTypeTable()[type]->Size;
+		}
+		mPartition->Assign(entity.mIndex, cell, bytes);
+	}
+
+	void Registry::RequestCell(const CellId cell)
+	{
+		CORE_ASSERT(mPartition != nullptr, "Streaming is not enabled")
+		mPartition->Touch(cell);
+
+		const CellState state = mPartition->GetState(cell);
+		if (state == CellState::Evicted || state == CellState::Saving)
+			mPartition->QueueLoad(cell);
+	}
+
+	void Registry::EvictCell(const CellId cell)
+	{
+		CORE_ASSERT(mPartition != nullptr, "Streaming is not enabled")
+		if (mPartition->GetState(cell) != CellState::Resident)
+			return;
+
+		CH_PROFILE_FUNCTION();
+		// Destroying unassigns, so work on a copy
+		const std::span<const u32> members = mPartition->GetEntities(cell);
+		std::vector<u32> entities(members.begin(), members.end());
+		std::ranges::sort(entities);
+
+		// Entities marked for destruction are not written, they go now instead of at the next flush
+		std::vector<u32> kept;
+		std::ranges::copy_if(entities, std::back_inserter(kept), [&](const u32 index) { return !mData.Entities[index].IsPendingDestroy(); });
+		std::optional<std::vector<u8>> chunk = WriteChunk(cell, kept);
+		if (!chunk.has_value())
+		{
+			// Stays resident, counts as used so the budget loop moves on to the next cell
+			mPartition->Touch(cell);
+			return;
+		}
+		DestroyEntities(entities);
+
+		mPartition->QueueSave(cell, std::move(*chunk));
+	}
+
+	/**
+	 * \brief Applies the finished I/O in the order it was queued, then evicts the
+	 * least recently requested cells until the resident components fit the
+	 * memory budget. Cells requested this frame are never evicted
+	 */
+	void Registry::UpdateStreaming()
+	{
+		CH_PROFILE_FUNCTION();
+		CORE_ASSERT(mPartition != nullptr, "Streaming is not enabled")
+
+		for (const WorldPartition::Completion& completion : mPartition->TakeCompletions())
+		{
+			const CellState state = mPartition->GetState(completion.Cell);
+			if (!completion.Load)
+			{
+				if (!completion.Ok)
+				{
+					// Nothing reached the disk, the entities come back from the chunk that was kept
+					mPartition->SetState(completion.Cell, CellState::Resident);
+					const bool restored = ReadChunk(completion.Cell, completion.Chunk);
+					CORE_ASSERT(restored, "Chunk written by this registry could not be read back")
+				}
+				// A load queued behind the save keeps the cell loading
+				else if (state == CellState::Saving)
+				{
+					mPartition->SetState(completion.Cell, CellState::Evicted);
+				}
+				continue;
+			}
+
+			// The save before this load failed, the cell is resident again already
+			if (state != CellState::Loading)
+				continue;
+
+			// A failed load keeps the cell evicted, requesting it again retries
+			mPartition->SetState(completion.Cell, CellState::Resident);
+			if (!completion.Ok || !ReadChunk(completion.Cell, std::span<const u8>(completion.File->GetData(), completion.File->GetSize())))
+				mPartition->SetState(completion.Cell, CellState::Evicted);
+		}
+
+		while (mPartition->IsOverBudget())
+		{
+			const std::optional<CellId> cell = mPartition->FindEvictionCandidate();
+			if (!cell.has_value())
+				break;
+			EvictCell(*cell);
+		}
+
+		mPartition->AdvanceFrame();
+	}
+
+	/**
+	 * \brief Packs the entities of a cell into a chunk. Every component type
+	 * becomes one column, the components are copied bitwise in the order of
+	 * entities
+	 * \param entities Entity indices of the cell
+	 * \return Contents of the chunk file, nothing if a component type was not
+	 * registered with RegisterStreamedComponents
+	 */
+	std::optional<std::vector<u8>> Registry::WriteChunk(const CellId cell, const std::span<const u32> entities)
+	{
+		CH_PROFILE_FUNCTION();
+
+		// Per type the position of its entities in the entity records
+		std::array<std::vector<u32>, MaxComponentTypes> slots;
+		for (u32 slot = 0; slot < (u32)entities.size(); slot++)
+		{
+			const Entity& entity = mData.Entities[entities[slot]];
+			for (ComponentId id = 0; id < MaxComponentTypes; id++)
+			{
+				if (entity.mSignature.test(id) && mData.ComponentIndices[id].Contains(entity.mIndex))
+					slots[id].push_back(slot);
+			}
+		}
+
+		// Added after SetCell, chunks are copied bitwise so the cell cannot be written
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (!slots[id].empty() && !mStreamedTypes.test(id))
+			{
+				CORE_ERROR("Cell {} is not evicted, component {} was not registered with RegisterStreamedComponents", cell, ComponentTypeTable()[id]->Type.name());
+				return std::nullopt;
+			}
+		}
+
+		ChunkHeader header{ ChunkMagic, ChunkVersion, cell, (u32)entities.size(), 0 };
+		for (const std::vector<u32>& column : slots)
+			header.ColumnCount += column.empty() ? 0 : 1;
+
+		std::vector<ChunkColumn> columns;
+		columns.reserve(header.ColumnCount);
+		u64 size = sizeof(ChunkHeader) + entities.size() * sizeof(ChunkEntity) + header.ColumnCount * sizeof(ChunkColumn);
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (slots[id].empty())
+				continue;
+
+			const ComponentTypeInfo& info = *ComponentTypeTable()[id];
+
+			ChunkColumn& column = columns.emplace_back(ChunkColumn{ id, (u32)info.Size, (u32)slots[id].size(), 0, 0 });
+			column.SlotOffset = AlignChunkOffset(size);
+			column.DataOffset = AlignChunkOffset(column.SlotOffset + column.Count * sizeof(u32));
+			size = column.DataOffset + (u64)column.Count * column.Size;
+		}
+
+		std::vector<u8> chunk(size);
+		u8* data = chunk.data();
+		memcpy_s(data, size, &header, sizeof(ChunkHeader));
+
+		u8* records = data + sizeof(ChunkHeader);
+		for (usize slot = 0; slot < entities.size(); slot++)
+		{
+			const Entity& entity = mData.Entities[entities[slot]];
+			// Value initialized, the padding is zeroed too
+			ChunkEntity record = ChunkEntity();
+			record.Id = entity.Id;
+			record.Types = entity.mSignature.to_ullong();
+			record.HasParent = entity.mParent != InvalidIndex;
+			if (record.HasParent)
+				memcpy_s(&record.Parent, sizeof(UUID), &mData.Entities[entity.mParent].Id, sizeof(UUID));
+			memcpy_s(records + slot * sizeof(ChunkEntity), sizeof(ChunkEntity), &record, sizeof(ChunkEntity));
+		}
+
+		u8* column_headers = records + entities.size() * sizeof(ChunkEntity);
+		for (usize c = 0; c < columns.size(); c++)
+		{
+			const ChunkColumn& column = columns[c];
+			memcpy_s(column_headers + c * sizeof(ChunkColumn), sizeof(ChunkColumn), &column, sizeof(ChunkColumn));
+			memcpy_s(data + column.SlotOffset, column.Count * sizeof(u32), slots[column.Type].data(), column.Count * sizeof(u32));
+
+			const ComponentIndex& index = mData.ComponentIndices[column.Type];
+			u8* components = data + column.DataOffset;
+			for (u32 i = 0; i < column.Count; i++)
+			{
+				const u32 entity = entities[slots[column.Type][i]];
+				memcpy_s(components + (usize)i * column.Size, column.Size, index.Get(entity)->Component, column.Size);
+			}
+		}
+
+		return chunk;
+	}
+
+	/**
+	 * \brief Recreates the entities of a chunk. They keep their id's but
+	 * get new indices, the components are copied straight out of the mapping
+	 * into the pools. Parents outside of the cell are linked again if they are
+	 * resident
+	 * \param chunk Mapped chunk file, or the chunk of a save that failed
+	 * \return False if the chunk does not belong to the cell, nothing is restored then
+	 */
+	bool Registry::ReadChunk(const CellId cell, const std::span<const u8> chunk)
+	{
+		CH_PROFILE_FUNCTION();
+		const u8* data = chunk.data();
+
+		if (chunk.size() < sizeof(ChunkHeader))
+		{
+			CORE_ERROR("Chunk of cell {} is truncated", cell);
+			return false;
+		}
+		ChunkHeader header;
+		memcpy_s(&header, sizeof(ChunkHeader), data, sizeof(ChunkHeader));
+		if (header.Magic != ChunkMagic || header.Version != ChunkVersion || header.Cell != cell
+			|| chunk.size() < sizeof(ChunkHeader) + (u64)header.EntityCount * sizeof(ChunkEntity) + (u64)header.ColumnCount * sizeof(ChunkColumn))
+		{
+			CORE_ERROR("Chunk file does not belong to cell {}", cell);
+			return false;
+		}
+
+		std::vector<ChunkEntity> records(header.EntityCount);
+		memcpy_s(records.data(), records.size() * sizeof(ChunkEntity), data + sizeof(ChunkHeader), records.size() * sizeof(ChunkEntity));
+
+		mData.EntityIndices.reserve(mData.EntityIndices.size() + records.size());
+		std::vector<Entity*> entities(records.size());
+		for (usize slot = 0; slot < records.size(); slot++)
+		{
+			entities[slot] = &MaterializeEntity(mEntityAllocator.Reserve(), records[slot].Id);
+			mPartition->Assign(entities[slot]->mIndex, cell, 0);
+		}
+
+		// Columns are per type, the handles are collected per entity so each entity is attached once
+		using SlotHandle = std::pair<u32, IHandle*>;
+		std::vector<SlotHandle> handles;
+		const u8* column_headers = data + sizeof(ChunkHeader) + records.size() * sizeof(ChunkEntity);
+		for (u32 c = 0; c < header.ColumnCount; c++)
+		{
+			ChunkColumn column;
+			memcpy_s(&column, sizeof(ChunkColumn), column_headers + c * sizeof(ChunkColumn), sizeof(ChunkColumn));
+
+			const ComponentTypeInfo* info = column.Type < MaxComponentTypes ? ComponentTypeTable()[column.Type] : nullptr;
+			CORE_ASSERT(info != nullptr && info->Size == column.Size, "Chunk was written with other component types")
+
+			const u8* components = data + column.DataOffset;
+			for (u32 i = 0; i < column.Count; i++)
+			{
+				u32 slot;
+				memcpy_s(&slot, sizeof(u32), data + column.SlotOffset + i * sizeof(u32), sizeof(u32));
+				const u8* source = components + (usize)i * column.Size;
+
+				if (info->Hash != nullptr)
+				{
+					// Trivially copyable, so the move only reads the mapped bytes
+					handles.emplace_back(slot, StoreShared(*info, (u8*)source));
+					continue;
+				}
+
+				IHandle* new_handle = AllocateComponent(*info);
+				memcpy_s(new_handle->Component, info->Size, source, info->Size);
+				handles.emplace_back(slot, new_handle);
+			}
+		}
+		std::ranges::stable_sort(handles, {}, &SlotHandle::first);
+
+		std::vector<IHandle*> entity_handles;
+		auto next = handles.begin();
+		for (u32 slot = 0; slot < (u32)records.size(); slot++)
+		{
+			entity_handles.clear();
+			Signature types;
+			for (; next != handles.end() && next->first == slot; ++next)
+			{
+				entity_handles.push_back(next->second);
+				types.set(next->second->Info->Index);
+			}
+
+			// What is left of the signature are tags
+			AttachComponents(entities[slot], entity_handles, Signature(records[slot].Types) & ~types);
+
+			if (records[slot].HasParent && mData.EntityIndices.contains(records[slot].Parent))
+				GetEntity(records[slot].Parent).AddChildEntity(entities[slot]);
+		}
+		return true;
 	}
 
 }
@@ -8,13 +8,30 @@
 #include "Group.h"
 #include "Handle.h"
 #include "Containers.h"
+#include "Context.h"
+#include "EntityAllocator.h"
+#include "Query.h"
 #include "RegistryData.h"
+#include "RenderExtraction.h"
+#include "Shared.h"
+#include "Snapshot.h"
+#include "SpatialIndex.h"
+#include "Staging.h"
+#include "Streaming.h"
+#include "Trace.h"
 #include "View.h"
 
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <memory>
 #include <string>
 #include <set>
+#include <span>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <ranges>
 #include <typeinfo>
 #include <typeindex>
 #include <utility>
@@ -26,16 +43,31 @@ namespace Steve
 
 	class Registry
 	{
-	#define GROUPTYPES_IT std::map<const UUID&, std::vector<std::type_index>>::iterator
+	#define GROUPTYPES_IT std::map<UUID, Signature>::iterator
 	#define GROUPTYPES_END std::end(mGroupTypes)
 
         friend class Scene;
+        friend class Entity;
+        friend class TraceReplayer;
+        friend class RegistryTests;
+	public:
+        // Public so a clone can be owned by a std::unique_ptr
+		~Registry()
+		{
+            // Arenas only free bytes, so every live component, grouped or not, is destroyed through its type first
+            for (IHandle* handle : mData.ComponentHandles | std::views::values)
+            {
+                if (handle->Info->Destroy != nullptr)
+                    handle->Info->Destroy(handle->Component);
+                mData.HandlePool.Destroy(handle);
+            }
+		}
+
 	private:
 		Registry() {}
-        Registry(RegistryData&& reg_data) : mData(reg_data) {}
-		~Registry() {}
-        
-        std::optional<const UUID&> IsInGroup(std::type_index type);
+        Registry(RegistryData&& reg_data) : mData(std::move(reg_data)) {}
+
+        std::optional<UUID> IsInGroup(ComponentId type);
 
 		template<typename ...Ts>
         void GroupComponents()
@@ -44,33 +76,115 @@ namespace Steve
 
             // Check if any component already in a group
             bool isInGroup = false;
-            (void(isInGroup ? isInGroup : IsInGroup(std::type_index(typeid(Ts))).has_value()), ...);
+            (void(isInGroup = isInGroup || IsInGroup(GetComponentId<Ts>()).has_value()), ...);
             CORE_ASSERT(!isInGroup, "Component already in group")
 
+            const Signature types = MakeSignature<Ts...>();
+            PrepareWrite(types);
+
+            // Only drops the bookkeeping, the bytes stay valid until the group has moved them
+            for (const Entity& entity : mData.Entities)
+            {
+                if (!entity.ContainsAll(types))
+                    continue;
+                (void(GetRestComponents(GetComponentId<Ts>()).Remove(mData.ComponentIndices[GetComponentId<Ts>()].Get(entity.mIndex))), ...);
+            }
 
-            Group<Ts...> group(&mData);
-            group.SetAll();
+            std::unique_ptr<IGroup> group = std::make_unique<Group<Ts...>>(&mData);
+            group->SetAll();
 
-            // At this point, group has copy's of the object
-            // Next remove them from the old containers
+            const UUID id;
+            mGroupTypes.emplace(id, types);
+            mGroups.emplace(id, std::move(group));
+        }
 
-            CH_PROFILE_FUNCTION();
-            View<Ts...> view;
-            for (std::tuple<Handle<Ts>&...>& tup : view) {
-                std::apply(mData.RestComponents.Remove, tup.Id);
+		template<typename T> requires (!TagComponent<T>)
+		Handle<std::remove_cvref_t<T>>& AddComponent(Entity* entity, T&& component)
+        {
+            using Type = std::remove_cvref_t<T>;
+            CORE_ASSERT(mData.EntityIndices.contains(entity->Id), "Entity does not exists so component cannot be added")
+
+            if constexpr (SharedComponent<Type>)
+            {
+                // Equal values share one handle, the argument is only moved into storage if it is new
+                Type value(std::forward<T>(component));
+                return (Handle<Type>&)*AcquireShared(entity, GetComponentTypeInfo<Type>(), (u8*)&value);
+            }
+            else
+            {
+                // Constructed in place, the argument is moved or copied, never memcpy'd
+                IHandle* new_handle = AllocateComponent(GetComponentTypeInfo<Type>());
+                new(new_handle->Component) Type(std::forward<T>(component));
+                AttachComponent(entity, new_handle);
+
+                return (Handle<Type>&)*new_handle;
             }
         }
 
-		template<typename T>
-		Handle<T>& AddComponent(Entity* entity, T&& component)
+        // Tags have no data, only the signature bit gets set
+        template<TagComponent T>
+        void AddComponent(Entity* entity, T&& = {})
         {
-            CORE_ASSERT(mData.Entities.contains(entity->Id), "Entity does not exists so component cannot be added")
-                
-            Handle<T> handle(component);
-            IHandle* new_handle = AddComponent(entity, (IHandle*)&handle);
-            entity->AddedComponent(new_handle);
+            CORE_ASSERT(mData.EntityIndices.contains(entity->Id), "Entity does not exists so component cannot be added")
+            entity->AddComponent<std::remove_cvref_t<T>>();
+        }
+
+        // Adds every component in one go: the signature is computed once, every query and index hears about the
+        // entity once and it moves into a group at most once, no matter how many of the types complete one
+        template<typename ...Ts>
+        void AddComponents(Entity* entity, Ts&&... components)
+        {
+            CH_PROFILE_FUNCTION();
+            CORE_ASSERT(mData.EntityIndices.contains(entity->Id), "Entity does not exists so components cannot be added")
+            CORE_ASSERT((entity->mSignature & MakeSignature<Ts...>()).none(), "Entity already has one of the components")
+
+            std::array<IHandle*, sizeof...(Ts)> handles{};
+            usize count = 0;
+            Signature tags;
+            ([&]()
+                {
+                    using Type = std::remove_cvref_t<Ts>;
+                    const ComponentTypeInfo& info = GetComponentTypeInfo<Type>();
+                    if constexpr (TagComponent<Type>)
+                    {
+                        tags.set(info.Index);
+                    }
+                    else if constexpr (SharedComponent<Type>)
+                    {
+                        Type value(std::forward<Ts>(components));
+                        handles[count++] = StoreShared(info, (u8*)&value);
+                    }
+                    else
+                    {
+                        IHandle* new_handle = AllocateComponent(info);
+                        new(new_handle->Component) Type(std::forward<Ts>(components));
+                        handles[count++] = new_handle;
+                    }
+                }(), ...);
+
+            AttachComponents(entity, std::span<IHandle* const>(handles.data(), count), tags);
+        }
+
+        // Counterpart of AddComponents, components that are left in a group go back to the rest storage once
+        template<typename ...Ts>
+        void RemoveComponents(Entity* entity)
+        {
+            CH_PROFILE_FUNCTION();
+            CORE_ASSERT(entity->ContainsAll<Ts...>(), "Entity does not have all of the components")
+
+            std::array<IHandle*, sizeof...(Ts)> handles{};
+            usize count = 0;
+            Signature tags;
+            ([&]()
+                {
+                    const ComponentId id = GetComponentId<Ts>();
+                    if constexpr (TagComponent<Ts>)
+                        tags.set(id);
+                    else
+                        handles[count++] = mData.ComponentIndices[id].Get(entity->mIndex);
+                }(), ...);
 
-            return (Handle<T>&)*new_handle;
+            DetachComponents(entity, std::span<IHandle* const>(handles.data(), count), tags);
         }
 
         // Invalidates all handle references
@@ -80,28 +194,352 @@ namespace Steve
             DestroyComponent((IHandle*)&component_handle);
 		}
         
-        Entity& GetEntity(const UUID& id)
+        // Calls function(const T& value, std::span<const u32> entities) once per distinct Shared<T> value, entities are indices for GetEntity
+        // Lets systems batch by mesh or material without sorting the entities
+        template<typename T, typename F>
+        void ForEachShared(F&& function)
+        {
+            for (const std::vector<IHandle*>& values : mData.SharedValues[GetComponentId<Shared<T>>()] | std::views::values)
+            {
+                for (IHandle* handle : values)
+                    function((*(Handle<Shared<T>>*)handle)->Get(), std::span<const u32>(handle->mOwners));
+            }
+        }
+
+        UUID CreateEntity();
+
+        // Views skip the entity right away, it is destroyed with all of its components at the next Flush
+        void MarkForDestroy(const UUID& entity);
+
+        // Sync point, destroys every entity marked since the last flush
+        // Every pool is visited once and compacts at most once, no matter how many entities go
+        void Flush();
+
+        Entity& GetEntity(const UUID& id);
+        Entity& GetEntity(u32 index) { return mData.Entities[index]; }
+
+        // Cached entity list for the masks, filled on first use and updated incrementally after that
+        Query& GetQuery(const QueryMasks& masks);
+        // Lookup only, nullptr if no view with the masks was created yet
+        [[nodiscard]] Query* FindQuery(const QueryMasks& masks);
+
+        // Terms are component types or Include/Exclude/Optional/AnyOf
+        // Iterates the cached query of the terms, so repeated views pay nothing for matching
+        template<typename ...Terms>
+        [[nodiscard]] View<Terms...> GetView()
 		{
-            return mData.Entities[id];
+            const QueryMasks& masks = View<Terms...>::GetMasks();
+            PrepareWrite(masks.Write);
+            if (mRecorder != nullptr)
+                mRecorder->View(masks);
+            return View<Terms...>(&mData, GetQuery(masks));
 		}
 
-        template<typename ...Ts>
-        [[nodiscard]] View<Ts...> GetView()
+        // Only visits the entities in the list that match the terms, e.g. the result of a spatial query
+        template<typename ...Terms>
+        [[nodiscard]] View<Terms...> GetView(std::span<const u32> entities)
 		{
-            return View<Ts...>(mData);
+            const QueryMasks& masks = View<Terms...>::GetMasks();
+            PrepareWrite(masks.Write);
+            if (mRecorder != nullptr)
+                mRecorder->View(masks);
+            return View<Terms...>(&mData, GetQuery(masks), entities);
 		}
 
+        // Creates the cached query of the terms, call at a sync point before a reader thread uses GetReadView
+        template<typename ...Terms>
+        void RegisterView() { (void)GetQuery(View<Terms...>::GetMasks()); }
+
+        // For reader threads like rendering or networking that run next to the simulation, terms must be const
+        // Only looks up the query made by RegisterView, nothing in the registry is written or traced
+        // The lookup is only safe while no other thread creates a query, so register every view before the readers start
+        template<typename ...Terms>
+        [[nodiscard]] View<Terms...> GetReadView()
+        {
+            const QueryMasks& masks = View<Terms...>::GetMasks();
+            CORE_ASSERT(masks.Write.none(), "A read view only takes const terms")
+
+            Query* query = FindQuery(masks);
+            CORE_ASSERT(query != nullptr, "View was not registered, call RegisterView at a sync point first")
+            return View<Terms...>(&mData, *query);
+        }
+
+        // Grid over the bounds of T, bounds maps a const T& to an AABB
+        // Entities are added and removed together with their T, call UpdateSpatialIndex after T's have moved
+        template<typename T, typename F>
+        void EnableSpatialIndex(f32 cell_size, F&& bounds)
+        {
+            static_assert(!TagComponent<T>, "Tags have no bounds");
+            mSpatialType = GetComponentId<T>();
+            mSpatialBounds = [bounds = std::forward<F>(bounds)](const u8* component) -> AABB { return bounds(*(const T*)component); };
+            BuildSpatialIndex(cell_size);
+        }
+
+        // Moves the entities whose bounds crossed a cell border
+        void UpdateSpatialIndex();
+
+        // Entity indices, valid until the next spatial query, can be passed to GetView
+        // Empty if the spatial index is not enabled
+        std::span<const u32> QueryAABB(const AABB& box) { return HasSpatialIndex() ? mSpatialIndex->QueryAABB(box) : std::span<const u32>(); }
+        std::span<const u32> QuerySphere(const glm::vec3& center, f32 radius) { return HasSpatialIndex() ? mSpatialIndex->QuerySphere(center, radius) : std::span<const u32>(); }
+        // Nearest first
+        std::span<const u32> QueryNearest(const glm::vec3& point, usize count) { return HasSpatialIndex() ? mSpatialIndex->QueryNearest(point, count) : std::span<const u32>(); }
+
+        // Packs every entity matching Terms into the back buffer of target, sorted on key, and makes it the front
+        // pack(Instance&, components...) fills one instance, key(components...) returns the sort key, e.g. material << 32 | mesh
+        // Both run on several threads at once, so terms must be const: they only read and do not count as changes
+        // Entities whose fetched components were not written, added or removed since the last extraction are copied, not packed
+        // The work is split with ParallelFor, which starts its threads on every call, see there
+        template<typename ...Terms, typename Instance, typename Pack, typename Key>
+        void ExtractInstances(InstanceBuffer<Instance>& target, Pack&& pack, Key&& key)
+        {
+            static_assert(View<Terms...>::ReadOnly, "Extraction fetches on worker threads, every term must be const");
+            const View<Terms...> view = GetView<Terms...>();
+
+            const QueryMasks& masks = View<Terms...>::GetMasks();
+            // Every type pack can see, tags have no data and are not in any index
+            const Signature tracked_types = masks.Include | masks.AnyOf | masks.Optional;
+            std::vector<const ComponentIndex*> tracked;
+            for (ComponentId id = 0; id < MaxComponentTypes; id++)
+            {
+                if (tracked_types.test(id) && !ComponentTypeTable()[id]->Tag)
+                    tracked.push_back(&mData.ComponentIndices[id]);
+            }
+
+            // Writes after this get a newer tick than the extraction
+            target.Extract(view, tracked, mData.ChangeTick++, mData.Entities.size(), pack, key);
+        }
+
+        // End of tick, the back buffer of every DoubleBuffered component becomes the front
+        // Nobody may be iterating a DoubleBuffered view while this runs
+        void SwapBuffers() { mData.FrontBuffer ^= 1; }
+
+        // Registry wide resource of type T like time or input, replaces the one there is
+        // Needs declared write access to T, like EraseCtx
+        template<typename T, typename ...Args>
+        T& EmplaceCtx(Args&&... args) { return mContext.Emplace<T>(std::forward<Args>(args)...); }
+
+        // Direct reference to the resource, Ctx<const T>() is read only access and Ctx<T>() mutable access
+        // Both are checked against the access passed to DeclareCtxAccess
+        template<typename T>
+        [[nodiscard]] T& Ctx()
+        {
+            T* resource = mContext.Find<T>();
+            CORE_ASSERT(resource != nullptr, "Resource does not exist")
+            return *resource;
+        }
+
+        // nullptr if there is no resource of type T
+        template<typename T>
+        [[nodiscard]] T* FindCtx() { return mContext.Find<T>(); }
+
+        template<typename T>
+        void EraseCtx() { mContext.Erase<T>(); }
+
+        // Set by a scheduler on the thread that runs a system, e.g. &ContextAccess::Of<const Time, Input>(), nullptr stops checking
+        void DeclareCtxAccess(const ContextAccess* access) { mContext.SetDeclaredAccess(access); }
+
+        // Buffer for one worker thread, it can create entities and add components without touching the registry
+        // Creating buffers is thread safe, using one buffer from several threads is not
+        StagingBuffer& CreateStagingBuffer();
+
+        // Sync point, moves the contents of every staging buffer into the registry
+        // No thread may use a staging buffer while this runs
+        void MergeStaging();
+
+        // Immutable view of the world that can be read on other threads while the simulation runs
+        // Pools are shared until the registry writes to them, only then they get copied
+        // Handles fetched before the snapshot must be fetched again before writing through them
+        [[nodiscard]] std::shared_ptr<const RegistrySnapshot> Snapshot();
+
+        // World partition streaming, chunk files of evicted cells are written to directory
+        // Once the components of resident cells take more than memory_budget bytes, the least recently requested cells get evicted
+        // Component types have to be registered with RegisterStreamedComponents before entities with them get a cell
+        void EnableStreaming(const std::filesystem::path& directory, usize memory_budget);
+
+        // Chunk files hold the raw bytes of the components, so only trivially copyable types compile
+        // Tags are stored in the entity signature and do not need to be registered
+        template<typename ...Ts>
+        void RegisterStreamedComponents()
+        {
+            static_assert((std::is_trivially_copyable_v<Ts> && ...), "Only trivially copyable components can be streamed");
+            mStreamedTypes |= MakeSignature<Ts...>();
+        }
+
+        // The entity and its components are evicted and restored together with cell
+        // Refused with an error if one of its components was not registered with RegisterStreamedComponents
+        void SetCell(const UUID& entity, CellId cell);
+
+        // Marks cell as used this frame, an evicted cell is loaded in the background
+        void RequestCell(CellId cell);
+
+        // Removes the entities of cell right away, the chunk file is written in the background
+        // Hierarchy links to entities outside of the cell are cut
+        // The cell stays resident if an unregistered component was added to one of its entities after SetCell
+        void EvictCell(CellId cell);
+
+        // Sync point, restores the cells that finished loading and evicts while over the memory budget
+        void UpdateStreaming();
+
+        [[nodiscard]] CellState GetCellState(CellId cell) const { return mPartition->GetState(cell); }
+
+        // Records every entity create and destroy, component add and remove and view to a compact binary trace at path
+        // tools/ecs_replay replays it and reports throughput and latency percentiles
+        void StartTrace(const std::filesystem::path& path);
+        // Writes the rest of the trace
+        void StopTrace() { mRecorder.reset(); }
+
+        // Deep copy of the whole world, entities keep their id's
+        // Streaming state is not copied, the clone has every resident entity and no cells
+        [[nodiscard]] std::unique_ptr<Registry> Clone() const;
+
+        // Stamps count copies of prefab and all of its children, returns the new root entities
+        // Entity references inside the prefab hierarchy point to the new copies
+        std::vector<UUID> Instantiate(const UUID& prefab, usize count = 1);
+
 	private:
         // Untemplated logic implementation, so Entity can also access this;
-        IHandle* AddComponent(Entity* entity, IHandle* component_handle);
+        IHandle* AllocateComponent(const ComponentTypeInfo& info);
+        void AttachComponent(Entity* entity, IHandle* component_handle);
+        // Hooks up constructed components and sets the tag bits with a single signature change
+        void AttachComponents(Entity* entity, std::span<IHandle* const> handles, const Signature& tags);
+        // Unhooks components and clears the tag bits with a single signature change
+        // Components without owners left are freed
+        void DetachComponents(Entity* entity, std::span<IHandle* const> handles, const Signature& tags);
+        // Detaches the component from every owner
         void DestroyComponent(IHandle* component_handle);
+        // Destroys components of one type and releases their storage, they have no owners anymore
+        void FreeComponents(std::span<IHandle* const> component_handles);
+        // Groups that lose one of types hand all of entity's components back to the rest storage
+        void LeaveGroups(Entity& entity, const Signature& types);
+        IHandle* AcquireShared(Entity* entity, const ComponentTypeInfo& info, u8* value);
+        // Stored value equal to value, moved into storage if there is none yet
+        IHandle* StoreShared(const ComponentTypeInfo& info, u8* value);
+        // Drops the reference of entity, the value is destroyed with its last owner
+        void ReleaseShared(Entity* entity, IHandle* component_handle);
+        ComponentContainer& GetRestComponents(ComponentId type);
+        // Copy of source for another entity, it still has to be attached
+        IHandle* CopyComponent(const IHandle& source, const EntityRemap& remap);
+        Entity& EmplaceEntity();
+        Entity& MaterializeEntity(u32 index, const UUID& id);
+        void RegisterQuery(Query* query);
+        // Updates the queries that include or exclude type, called on every signature change
+        void SignatureChanged(const Entity& entity, ComponentId type);
+        // Same for several types at once, a query that matches on more than one of them is updated once
+        void SignatureChanged(const Entity& entity, const Signature& types);
+        // Spatial index and cell sizes follow the components they are built on
+        void UpdateIndices(const Entity& entity, ComponentId type);
+        static void CollectHierarchy(Entity& root, std::vector<Entity*>& entities);
+        // Destroys every component, unlinks the hierarchy and frees the indices
+        // entities has to be sorted
+        void DestroyEntities(std::span<const u32> entities);
+        [[nodiscard]] std::optional<std::vector<u8>> WriteChunk(CellId cell, std::span<const u32> entities);
+        [[nodiscard]] bool ReadChunk(CellId cell, std::span<const u8> chunk);
+
+        // Write barrier, called before any write to the pools of types
+        void PrepareWrite(ComponentId type)
+        {
+            if (mData.SharedPools.test(type))
+                DetachSnapshots(Signature().set(type));
+        }
+        void PrepareWrite(const Signature& types)
+        {
+            if ((mData.SharedPools & types).any())
+                DetachSnapshots(mData.SharedPools & types);
+        }
+        void DetachSnapshots(const Signature& types);
+        void BuildSpatialIndex(f32 cell_size);
+        // Checked in every build, logs if the spatial index is not enabled
+        [[nodiscard]] bool HasSpatialIndex() const;
 
 	private:
-		std::map<const UUID&, std::vector<std::type_index>> mGroupTypes;
-		std::map<const UUID&, IGroup*> mGroups;
+		std::map<UUID, Signature> mGroupTypes;
+		std::map<UUID, std::unique_ptr<IGroup>> mGroups;
+
+		// Keyed by (include, exclude, any of)
+		std::map<std::tuple<u64, u64, u64>, std::unique_ptr<Query>> mQueries;
+		// ComponentId -> queries that match on it
+		std::array<std::vector<Query*>, MaxComponentTypes> mComponentQueries;
+		// Queries without include types, new entities can match them
+		std::vector<Query*> mUnfilteredQueries;
+		// Reused by the batched SignatureChanged
+		std::vector<Query*> mChangedQueries;
 
         RegistryData mData;
+        Context mContext;
+
+        // Optional, see EnableSpatialIndex
+        std::unique_ptr<SpatialGrid> mSpatialIndex;
+        std::function<AABB(const u8*)> mSpatialBounds;
+        ComponentId mSpatialType = 0;
+
+        // Optional, see EnableStreaming
+        std::unique_ptr<WorldPartition> mPartition;
+        // Registered by RegisterStreamedComponents, trivially copyable
+        Signature mStreamedTypes;
+
+        // Optional, see StartTrace
+        std::unique_ptr<TraceRecorder> mRecorder;
+
+        EntityAllocator mEntityAllocator;
+        // Marked by MarkForDestroy, destroyed by Flush
+        std::vector<u32> mPendingDestroy;
+        std::vector<std::unique_ptr<StagingBuffer>> mStagingBuffers;
+        std::mutex mStagingMutex;
 	};
+
+	// Entity members that need the complete Registry
+
+	template<typename T>
+	Handle<T>& Entity::GetComponent()
+	{
+		CH_PROFILE_FUNCTION();
+		static_assert(!TagComponent<T>, "Tags have no data, use Contains");
+		const ComponentId id = GetComponentId<T>();
+		CORE_ASSERT(mSignature.test(id), "Component with this type does not exist")
+
+		ComponentIndex& index = mRegistry->mData.ComponentIndices[id];
+		if constexpr (!std::is_const_v<T>)
+		{
+			mRegistry->PrepareWrite(id);
+			return *(Handle<T>*)index.GetMutable(mIndex, mRegistry->mData.ChangeTick);
+		}
+		else
+		{
+			return *(Handle<T>*)index.Get(mIndex);
+		}
+	}
+
+	template<typename T>
+	decltype(auto) Entity::AddComponent(T&& component) { return mRegistry->AddComponent(this, std::forward<T>(component)); }
+
+	template<typename ...Ts>
+	void Entity::AddComponents(Ts&&... components) { mRegistry->AddComponents(this, std::forward<Ts>(components)...); }
+
+	template<typename ...Ts>
+	void Entity::RemoveComponents() { mRegistry->RemoveComponents<Ts...>(this); }
+
+	template<typename T>
+	void Entity::DestroyComponent()
+	{
+		if constexpr (TagComponent<T>)
+			SetComponentBit(GetComponentId<T>(), false);
+		else if constexpr (SharedComponent<T>)
+			mRegistry->ReleaseShared(this, &GetComponent<T>());
+		else
+			mRegistry->DestroyComponent(&GetComponent<T>());
+	}
+
+	template<typename F>
+	void Entity::ForEachChild(F&& function)
+	{
+		for (u32 child = mFirstChild; child != InvalidIndex;)
+		{
+			Entity& entity = mRegistry->mData.Entities[child];
+			child = entity.mNextSibling;
+			function(entity);
+		}
+	}
 }
 
 
@@ -1,10 +1,15 @@
 #ifndef SIZEDB_HEADER_
 #define SIZEDB_HEADER_
 
+#include <array>
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <typeindex>
+#include <vector>
 
 #include "Containers.h"
+#include "FlatHashMap.h"
 #include "Entity.h"
 #include "Steve/Core/UUID.h"
 
@@ -12,9 +17,33 @@ namespace Steve
 {
 	struct RegistryData
 	{
-		std::unordered_map<UUID, IHandle> ComponentHandles;
-		std::unordered_map<UUID, Entity> Entities;
-		ComponentContainer RestComponents;
+		// Handles live in the pool, so they stay put when the table grows
+		// The pool does not destroy them, ~Registry does
+		UUIDMap<IHandle*> ComponentHandles;
+		ObjectPool<IHandle> HandlePool;
+
+		// Indexed by entity index, deque so references survive new entities
+		std::deque<Entity> Entities;
+		UUIDMap<u32> EntityIndices;
+
+		// Per ComponentId: entity index -> handle
+		std::array<ComponentIndex, MaxComponentTypes> ComponentIndices;
+
+		// Components that are not in a group, one arena per ComponentId so every type is packed densely
+		// Created on first use
+		std::array<std::unique_ptr<ComponentContainer>, MaxComponentTypes> RestComponents;
+
+		// Per ComponentId of Shared<T> types: content hash -> stored values with that hash
+		std::array<std::unordered_map<u64, std::vector<IHandle*>>, MaxComponentTypes> SharedValues;
+
+		// Which half of every DoubleBuffered component is the front, flipped by Registry::SwapBuffers
+		u32 FrontBuffer = 0;
+
+		// Stamped on every mutable component access, advanced by Registry::ExtractInstances
+		u32 ChangeTick = 1;
+
+		// Pools that a snapshot may still reference, they are copied before the next write
+		Signature SharedPools;
 	};
 }
 
@@ -0,0 +1,225 @@
+#ifndef RENDER_EXTRACTION_HEADER_
+#define RENDER_EXTRACTION_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/Profiling.h"
+
+#include "ComponentInfo.h"
+#include "Containers.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace Steve
+{
+	// Splits [0, count) over the hardware threads, the calling thread takes the first chunk
+	// Worker threads are started and joined on every call, which costs tens of microseconds per thread,
+	// so a thread is only added for every min_chunk items. Small counts run on the calling thread alone
+	template<typename F>
+	void ParallelFor(usize count, F&& function, usize min_chunk = 4096)
+	{
+		const usize hardware = std::max(1u, std::thread::hardware_concurrency());
+		const usize threads = std::clamp<usize>(count / min_chunk, 1, hardware);
+		const usize chunk = (count + threads - 1) / threads;
+
+		const auto run = [&](usize thread)
+			{
+				const usize end = std::min(count, (thread + 1) * chunk);
+				for (usize i = thread * chunk; i < end; i++)
+					function(i);
+			};
+
+		std::vector<std::jthread> workers;
+		workers.reserve(threads - 1);
+		for (usize thread = 1; thread < threads; thread++)
+			workers.emplace_back(run, thread);
+		run(0);
+	}
+
+	// Packed per instance data for upload, filled by Registry::ExtractInstances
+	// Double buffered: the front is the result of the last extraction and can be uploaded while the next one fills the back
+	// Instances are sorted on their key, so equal keys (material, mesh) form one contiguous draw range
+	template<typename Instance>
+	class InstanceBuffer
+	{
+		static_assert(std::is_trivially_copyable_v<Instance>, "Instances are uploaded as raw bytes");
+		friend class Registry;
+
+	public:
+		// instance_alignment rounds up the stride, buffer_alignment the start of the buffer
+		InstanceBuffer(usize instance_alignment = 16, usize buffer_alignment = 256)
+			: mStride((sizeof(Instance) + std::max(instance_alignment, alignof(Instance)) - 1) & ~(std::max(instance_alignment, alignof(Instance)) - 1)),
+			mAlignment(std::max(buffer_alignment, alignof(Instance))),
+			mBuffers{ Buffer(mAlignment), Buffer(mAlignment) }
+		{}
+
+		[[nodiscard]] const u8* GetData() const { return Front().Data.get(); }
+		[[nodiscard]] usize GetCount() const { return Front().Keys.size(); }
+		[[nodiscard]] usize GetStride() const { return mStride; }
+		[[nodiscard]] usize GetSizeInBytes() const { return GetCount() * mStride; }
+		// Sort key per instance, in buffer order
+		[[nodiscard]] std::span<const u64> GetKeys() const { return Front().Keys; }
+		// Entity index per instance, in buffer order
+		[[nodiscard]] std::span<const u32> GetEntities() const { return Front().Entities; }
+
+	private:
+		struct AlignedFree
+		{
+			usize Alignment;
+			void operator()(u8* data) const { ::operator delete(data, std::align_val_t(Alignment)); }
+		};
+
+		struct Buffer
+		{
+			Buffer(usize alignment) : Data(nullptr, AlignedFree{ alignment }) {}
+
+			std::unique_ptr<u8, AlignedFree> Data;
+			usize Capacity = 0;
+			std::vector<u64> Keys;
+			std::vector<u32> Entities;
+			// Entity index -> instance slot
+			std::vector<u32> Slots;
+			// Per instance, bit i is set if the entity had tracked[i] when it was packed
+			std::vector<u64> Presence;
+			// Change tick the buffer was extracted at
+			u32 Tick = 0;
+		};
+
+		struct SortEntry
+		{
+			u64 Key;
+			u32 Entity;
+			// Slot in the front buffer if the instance can be copied from there
+			u32 PreviousSlot;
+			u64 Presence;
+
+			bool operator<(const SortEntry& other) const { return Key != other.Key ? Key < other.Key : Entity < other.Entity; }
+		};
+
+		[[nodiscard]] const Buffer& Front() const { return mBuffers[mFront]; }
+		[[nodiscard]] Buffer& Front() { return mBuffers[mFront]; }
+		[[nodiscard]] Buffer& Back() { return mBuffers[mFront ^ 1]; }
+
+		/**
+		 * \brief Fills the back buffer from the entities of view and swaps.
+		 * Instances of entities that were in the front buffer and whose tracked
+		 * components did not change since are copied instead of packed, and
+		 * keep their place in the sort order, so only changed instances are sorted.
+		 * Gaining or losing a tracked component (like an Optional one) counts as a change
+		 * \param tracked Component indices of the types the instance is packed from, at most 64
+		 * \param tick Current change tick, the result counts as extracted at it
+		 */
+		template<typename ViewType, typename Pack, typename Key>
+		void Extract(const ViewType& view, std::span<const ComponentIndex* const> tracked, u32 tick, usize entity_count, Pack& pack, Key& key)
+		{
+			CH_PROFILE_FUNCTION();
+			CORE_ASSERT(tracked.size() <= 64, "Presence of the tracked components is a u64 mask")
+			const std::span<const u32> entities = view.GetEntities();
+			const Buffer& previous = Front();
+			Buffer& next = Back();
+
+			const auto presence = [&](u32 entity)
+				{
+					u64 mask = 0;
+					for (usize i = 0; i < tracked.size(); i++)
+					{
+						if (tracked[i]->Contains(entity))
+							mask |= 1ull << i;
+					}
+					return mask;
+				};
+
+			const auto previous_slot = [&](u32 entity, u64 mask) -> u32
+				{
+					if (entity >= previous.Slots.size() || previous.Slots[entity] == InvalidIndex)
+						return InvalidIndex;
+					if (previous.Presence[previous.Slots[entity]] != mask)
+						return InvalidIndex;
+					for (const ComponentIndex* index : tracked)
+					{
+						if (index->Contains(entity) && index->GetChangeTick(entity) > previous.Tick)
+							return InvalidIndex;
+					}
+					return previous.Slots[entity];
+				};
+
+			// Unchanged entries land on their old slot, which is already in sorted order
+			std::vector<SortEntry> entries(entities.size());
+			std::vector<SortEntry> kept(previous.Keys.size(), SortEntry{ 0, InvalidIndex, InvalidIndex, 0 });
+			ParallelFor(entities.size(), [&](usize i)
+				{
+					const u32 entity = entities[i];
+					const u64 mask = presence(entity);
+					const u32 slot = previous_slot(entity, mask);
+					if (slot != InvalidIndex)
+					{
+						kept[slot] = { previous.Keys[slot], entity, slot, mask };
+						entries[i].Entity = InvalidIndex;
+						return;
+					}
+					entries[i] = { std::apply(key, view.Fetch(entity)), entity, InvalidIndex, mask };
+				});
+
+			std::erase_if(entries, [](const SortEntry& entry) { return entry.Entity == InvalidIndex; });
+			std::erase_if(kept, [](const SortEntry& entry) { return entry.Entity == InvalidIndex; });
+			std::sort(entries.begin(), entries.end());
+
+			std::vector<SortEntry> order(entries.size() + kept.size());
+			std::merge(kept.begin(), kept.end(), entries.begin(), entries.end(), order.begin());
+
+			Reserve(next, order.size());
+			next.Keys.resize(order.size());
+			next.Entities.resize(order.size());
+			next.Presence.resize(order.size());
+			next.Slots.assign(entity_count, InvalidIndex);
+
+			ParallelFor(order.size(), [&](usize slot)
+				{
+					const SortEntry& entry = order[slot];
+					next.Keys[slot] = entry.Key;
+					next.Entities[slot] = entry.Entity;
+					next.Presence[slot] = entry.Presence;
+					next.Slots[entry.Entity] = (u32)slot;
+
+					u8* destination = next.Data.get() + slot * mStride;
+					if (entry.PreviousSlot != InvalidIndex)
+					{
+						memcpy_s(destination, mStride, previous.Data.get() + entry.PreviousSlot * mStride, sizeof(Instance));
+						return;
+					}
+
+					Instance& instance = *new(destination) Instance{};
+					std::apply([&](auto&&... components) { pack(instance, components...); }, view.Fetch(entry.Entity));
+				});
+
+			next.Tick = tick;
+			mFront ^= 1;
+		}
+
+		// Contents are not kept, every slot is rewritten by the extraction
+		void Reserve(Buffer& buffer, usize count)
+		{
+			if (count <= buffer.Capacity)
+				return;
+
+			buffer.Capacity = std::max(count, buffer.Capacity * 2);
+			buffer.Data.reset((u8*)::operator new(buffer.Capacity * mStride, std::align_val_t(mAlignment)));
+		}
+
+	private:
+		usize mStride;
+		usize mAlignment;
+
+		Buffer mBuffers[2];
+		u32 mFront = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SHARED_HEADER_
+#define SHARED_HEADER_
+
+#include "Steve/Core/Core.h"
+
+#include <concepts>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace Steve
+{
+	// Storage policy for values that many entities have in common, like a mesh or a material
+	// Registry::AddComponent stores equal values once and refcounts them, the handle is owned by every entity using it
+	// The value is immutable since every owner sees it, add a new Shared<T> to change it for one entity
+	// Registry::ForEachShared visits the entities grouped by value
+	template<typename T>
+	class Shared
+	{
+	public:
+		using SharedValueType = T;
+
+		Shared(const T& value) : mValue(value) {}
+		Shared(T&& value) : mValue(std::move(value)) {}
+
+		[[nodiscard]] const T& Get() const { return mValue; }
+		const T* operator->() const { return &mValue; }
+		const T& operator*() const { return mValue; }
+
+		// Content hash, std::hash<T> if there is one, the bytes of the value otherwise
+		[[nodiscard]] u64 Hash() const
+		{
+			if constexpr (requires(const T& value) { std::hash<T>{}(value); })
+			{
+				return std::hash<T>{}(mValue);
+			}
+			else
+			{
+				static_assert(std::has_unique_object_representations_v<T>, "Shared<T> needs std::hash<T> if T has padding");
+
+				// FNV-1a
+				u64 hash = 14695981039346656037ull;
+				const u8* bytes = (const u8*)&mValue;
+				for (usize i = 0; i < sizeof(T); i++)
+				{
+					hash ^= bytes[i];
+					hash *= 1099511628211ull;
+				}
+				return hash;
+			}
+		}
+
+		[[nodiscard]] bool operator==(const Shared& other) const
+		{
+			if constexpr (std::equality_comparable<T>)
+				return mValue == other.mValue;
+			else
+				return memcmp(&mValue, &other.mValue, sizeof(T)) == 0;
+		}
+
+	private:
+		T mValue;
+	};
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SNAPSHOT_HEADER_
+#define SNAPSHOT_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/UUID.h"
+
+#include "ComponentInfo.h"
+#include "FlatHashMap.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace Steve
+{
+	// Immutable copy of the world at one point in time, made by Registry::Snapshot
+	// Component pools are shared with the registry, which copies a pool the first time it writes to it afterwards
+	// Taking one only copies the entity records and the per type indices, never the component data of POD types
+	// Can be read from any thread while the simulation keeps running
+	class RegistrySnapshot
+	{
+		friend class Registry;
+
+	public:
+		struct EntityRecord
+		{
+			UUID Id;
+			// InvalidIndex for placeholder records
+			u32 Index = InvalidIndex;
+			Signature Types;
+		};
+
+		RegistrySnapshot() = default;
+		RegistrySnapshot(const RegistrySnapshot&) = delete;
+		RegistrySnapshot& operator=(const RegistrySnapshot&) = delete;
+
+		~RegistrySnapshot()
+		{
+			for (Column& column : mColumns)
+			{
+				if (column.Owned == nullptr || column.Info->Destroy == nullptr)
+					continue;
+				for (const u8* component : column.Data)
+					column.Info->Destroy((u8*)component);
+			}
+		}
+
+		// Indexed by entity index, same as RegistryData::Entities
+		[[nodiscard]] const std::vector<EntityRecord>& GetEntities() const { return mEntities; }
+
+		// nullptr if the entity did not exist
+		[[nodiscard]] const EntityRecord* FindEntity(const UUID& id) const
+		{
+			const auto it = mEntityIndices.find(id);
+			return it != mEntityIndices.end() ? &mEntities[it->second] : nullptr;
+		}
+
+		// nullptr if the entity did not have T
+		template<typename T>
+		[[nodiscard]] const T* Get(u32 entity_index) const
+		{
+			static_assert(!TagComponent<T>, "Tags have no data, check the signature");
+			const Column& column = mColumns[GetComponentId<T>()];
+			const u32 position = column.Find(entity_index);
+			return position != InvalidIndex ? (const T*)column.Data[position] : nullptr;
+		}
+
+		template<typename T>
+		[[nodiscard]] const T* Get(const UUID& id) const
+		{
+			const EntityRecord* record = FindEntity(id);
+			return record != nullptr ? Get<T>(record->Index) : nullptr;
+		}
+
+		// Calls function(const EntityRecord&, const Ts&...) for every entity that had all Ts
+		template<typename T, typename ...Ts, typename F>
+		void Each(F&& function) const
+		{
+			const Signature types = MakeSignature<T, Ts...>();
+			const Column& column = mColumns[GetComponentId<T>()];
+			for (usize i = 0; i < column.Entities.size(); i++)
+			{
+				const EntityRecord& record = mEntities[column.Entities[i]];
+				if ((record.Types & types) == types)
+					function(record, *(const T*)column.Data[i], *Get<Ts>(record.Index)...);
+			}
+		}
+
+		[[nodiscard]] usize GetSize() const { return mEntityIndices.size(); }
+		// Which half of DoubleBuffered components was the front
+		[[nodiscard]] u32 GetFrontBuffer() const { return mFrontBuffer; }
+
+	private:
+		// One component type, same layout as ComponentIndex but with the component addresses at snapshot time
+		struct Column
+		{
+			// Sparse is paged, a type with few instances only fills the pages its entities fall in
+			static constexpr u32 PageSize = 1024;
+
+			// Position in Entities and Data, InvalidIndex if the entity did not have the type
+			[[nodiscard]] u32 Find(u32 entity_index) const
+			{
+				const u32 page = entity_index / PageSize;
+				if (page >= Sparse.size() || Sparse[page] == nullptr)
+					return InvalidIndex;
+				return Sparse[page][entity_index % PageSize];
+			}
+
+			void Insert(u32 entity_index, u32 position)
+			{
+				const u32 page = entity_index / PageSize;
+				if (page >= Sparse.size())
+					Sparse.resize(page + 1);
+				if (Sparse[page] == nullptr)
+				{
+					Sparse[page] = std::make_unique<u32[]>(PageSize);
+					std::fill_n(Sparse[page].get(), PageSize, InvalidIndex);
+				}
+				Sparse[page][entity_index % PageSize] = position;
+			}
+
+			const ComponentTypeInfo* Info = nullptr;
+			std::vector<std::unique_ptr<u32[]>> Sparse;
+			std::vector<u32> Entities;
+			std::vector<const u8*> Data;
+			// Types that are not trivially copyable are copied when the snapshot is taken,
+			// a bitwise shared copy would alias their heap memory
+			std::unique_ptr<u8[]> Owned;
+		};
+
+		std::vector<EntityRecord> mEntities;
+		UUIDMap<u32> mEntityIndices;
+		std::array<Column, MaxComponentTypes> mColumns;
+
+		// Keeps the shared pools alive, the registry moves away from them when it writes
+		std::vector<std::shared_ptr<const u8>> mPools;
+
+		u32 mFrontBuffer = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "Registry.h"
+#include "Entity.h"
+#include "Testing.h"
+
+#include <string>
+
+namespace Steve
+{
+	namespace
+	{
+		struct Position
+		{
+			f32 X;
+		};
+
+		// Not trivially copyable, the snapshot keeps its own copy
+		struct Name
+		{
+			std::string Value;
+		};
+	}
+
+	// Friend of Registry, which is otherwise only reachable through Scene
+	class RegistryTests
+	{
+	public:
+		// Writes after the snapshot go to a private copy of the pool, the snapshot keeps seeing the old values
+		static void WritesAfterSnapshot()
+		{
+			Registry registry;
+			const UUID first = registry.CreateEntity();
+			const UUID second = registry.CreateEntity();
+			registry.GetEntity(first).AddComponent(Position{ 1.0f });
+			registry.GetEntity(second).AddComponent(Position{ 2.0f });
+			registry.GetEntity(first).AddComponent(Name{ "a name longer than the small string buffer" });
+
+			const std::shared_ptr<const RegistrySnapshot> snapshot = registry.Snapshot();
+
+			registry.GetEntity(first).GetComponent<Position>()->X = 10.0f;
+			registry.GetEntity(first).GetComponent<Name>()->Value = "renamed";
+			CHECK(registry.GetEntity(first).GetComponent<const Position>()->X == 10.0f);
+
+			CHECK(snapshot->Get<Position>(first) != nullptr && snapshot->Get<Position>(first)->X == 1.0f);
+			CHECK(snapshot->Get<Position>(second) != nullptr && snapshot->Get<Position>(second)->X == 2.0f);
+			CHECK(snapshot->Get<Name>(first) != nullptr && snapshot->Get<Name>(first)->Value == "a name longer than the small string buffer");
+			CHECK(snapshot->Get<Name>(second) == nullptr);
+		}
+
+		// Growing a shared pool moves the registry to new storage, the snapshot keeps the old one alive
+		static void PoolGrowthAfterSnapshot()
+		{
+			Registry registry;
+			const UUID first = registry.CreateEntity();
+			registry.GetEntity(first).AddComponent(Position{ 1.0f });
+
+			const std::shared_ptr<const RegistrySnapshot> snapshot = registry.Snapshot();
+			for (u32 i = 0; i < 1000; i++)
+				registry.GetEntity(registry.CreateEntity()).AddComponent(Position{ (f32)i });
+
+			CHECK(snapshot->GetSize() == 1);
+			CHECK(snapshot->Get<Position>(first)->X == 1.0f);
+			CHECK(registry.GetEntity(first).GetComponent<const Position>()->X == 1.0f);
+		}
+
+		// Removed and destroyed after the snapshot, still there in the snapshot
+		static void DestroyAfterSnapshot()
+		{
+			Registry registry;
+			const UUID first = registry.CreateEntity();
+			registry.GetEntity(first).AddComponent(Position{ 1.0f });
+			registry.GetEntity(first).AddComponent(Name{ "kept by the snapshot, not by the registry" });
+
+			const std::shared_ptr<const RegistrySnapshot> snapshot = registry.Snapshot();
+			registry.MarkForDestroy(first);
+			registry.Flush();
+
+			CHECK(snapshot->FindEntity(first) != nullptr);
+			CHECK(snapshot->Get<Position>(first)->X == 1.0f);
+			CHECK(snapshot->Get<Name>(first)->Value == "kept by the snapshot, not by the registry");
+		}
+
+		// Two snapshots taken around a write each see their own tick
+		static void SnapshotsAreIndependent()
+		{
+			Registry registry;
+			const UUID first = registry.CreateEntity();
+			registry.GetEntity(first).AddComponent(Position{ 1.0f });
+
+			const std::shared_ptr<const RegistrySnapshot> before = registry.Snapshot();
+			registry.GetEntity(first).GetComponent<Position>()->X = 2.0f;
+			const std::shared_ptr<const RegistrySnapshot> after = registry.Snapshot();
+			registry.GetEntity(first).GetComponent<Position>()->X = 3.0f;
+
+			CHECK(before->Get<Position>(first)->X == 1.0f);
+			CHECK(after->Get<Position>(first)->X == 2.0f);
+		}
+
+		// Rare types only fill the sparse pages of the entities that have them
+		static void SparseType()
+		{
+			Registry registry;
+			std::vector<UUID> entities;
+			for (u32 i = 0; i < 3000; i++)
+			{
+				entities.push_back(registry.CreateEntity());
+				registry.GetEntity(entities.back()).AddComponent(Position{ (f32)i });
+			}
+			registry.GetEntity(entities[2500]).AddComponent(Name{ "the only one with a name" });
+
+			const std::shared_ptr<const RegistrySnapshot> snapshot = registry.Snapshot();
+			CHECK(snapshot->Get<Name>(entities[2500])->Value == "the only one with a name");
+			CHECK(snapshot->Get<Name>(entities[0]) == nullptr);
+			CHECK(snapshot->Get<Name>(entities[2999]) == nullptr);
+			CHECK(snapshot->Get<Position>(entities[2999])->X == 2999.0f);
+		}
+	};
+}
+
+int main()
+{
+	Steve::RegistryTests::WritesAfterSnapshot();
+	Steve::RegistryTests::PoolGrowthAfterSnapshot();
+	Steve::RegistryTests::DestroyAfterSnapshot();
+	Steve::RegistryTests::SnapshotsAreIndependent();
+	Steve::RegistryTests::SparseType();
+	return Steve::Testing::Result();
+}
@@ -0,0 +1,351 @@
+#ifndef SPATIAL_INDEX_HEADER_
+#define SPATIAL_INDEX_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/Profiling.h"
+
+#include "ComponentInfo.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <ranges>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Steve
+{
+	struct AABB
+	{
+		glm::vec3 Min;
+		glm::vec3 Max;
+	};
+
+	// Uniform grid of entity indices, an entity is stored in every cell its bounds overlap
+	// Owned by the Registry, see Registry::EnableSpatialIndex
+	// Queries reuse one result buffer, a returned span is valid until the next query
+	class SpatialGrid
+	{
+	public:
+		SpatialGrid(f32 cell_size) : mCellSize(cell_size), mInvCellSize(1.0f / cell_size)
+		{
+			CORE_ASSERT(cell_size > 0.0f, "Cell size has to be positive")
+		}
+
+		void Insert(u32 entity, const AABB& bounds)
+		{
+			if (entity >= mEntries.size())
+			{
+				mEntries.resize(entity + 1);
+				mVisited.resize(entity + 1, 0);
+			}
+
+			Entry& entry = mEntries[entity];
+			CORE_ASSERT(!entry.Present, "Entity is already in the spatial index")
+			entry = { bounds, CellOf(bounds.Min), CellOf(bounds.Max), true };
+			AddToCells(entity, entry);
+			mCount++;
+		}
+
+		void Remove(u32 entity)
+		{
+			if (!Contains(entity))
+				return;
+
+			Entry& entry = mEntries[entity];
+			RemoveFromCells(entity, entry);
+			entry.Present = false;
+			mCount--;
+		}
+
+		// Only touches the cells if the bounds moved to a different cell range
+		void Update(u32 entity, const AABB& bounds)
+		{
+			Entry& entry = mEntries[entity];
+			const glm::ivec3 min_cell = CellOf(bounds.Min);
+			const glm::ivec3 max_cell = CellOf(bounds.Max);
+			if (min_cell != entry.MinCell || max_cell != entry.MaxCell)
+			{
+				RemoveFromCells(entity, entry);
+				entry.MinCell = min_cell;
+				entry.MaxCell = max_cell;
+				AddToCells(entity, entry);
+			}
+			entry.Bounds = bounds;
+		}
+
+		[[nodiscard]] bool Contains(u32 entity) const { return entity < mEntries.size() && mEntries[entity].Present; }
+		[[nodiscard]] usize GetSize() const { return mCount; }
+
+		// Entities whose bounds overlap box
+		std::span<const u32> QueryAABB(const AABB& box)
+		{
+			CH_PROFILE_FUNCTION();
+			BeginQuery();
+			ForEachCell(CellOf(box.Min), CellOf(box.Max), [&](const std::vector<u32>& cell)
+				{
+					for (const u32 entity : cell)
+					{
+						if (Visit(entity) && Overlaps(mEntries[entity].Bounds, box))
+							mResult.push_back(entity);
+					}
+				});
+			return mResult;
+		}
+
+		// Entities whose bounds are within radius of center
+		std::span<const u32> QuerySphere(const glm::vec3& center, f32 radius)
+		{
+			CH_PROFILE_FUNCTION();
+			BeginQuery();
+			const glm::vec3 extent(radius);
+			ForEachCell(CellOf(center - extent), CellOf(center + extent), [&](const std::vector<u32>& cell)
+				{
+					for (const u32 entity : cell)
+					{
+						if (Visit(entity) && DistanceSquared(mEntries[entity].Bounds, center) <= radius * radius)
+							mResult.push_back(entity);
+					}
+				});
+			return mResult;
+		}
+
+		// Up to count entities closest to point, nearest first
+		// Searches rings of cells around point and stops once no unvisited cell can be closer
+		std::span<const u32> QueryNearest(const glm::vec3& point, usize count)
+		{
+			CH_PROFILE_FUNCTION();
+			BeginQuery();
+			if (count == 0 || mCount == 0)
+				return mResult;
+
+			// Max heap on distance, front is the worst of the current best
+			mNearest.clear();
+			const auto closer = [](const std::pair<f32, u32>& l, const std::pair<f32, u32>& r) { return l.first < r.first; };
+
+			// Rings closer than the occupied cells are empty
+			const glm::ivec3 center = CellOf(point);
+			const glm::ivec3 gap = glm::max(glm::max(mOccupiedMin - center, center - mOccupiedMax), glm::ivec3(0));
+			const glm::ivec3 reach = glm::max(glm::abs(center - mOccupiedMin), glm::abs(mOccupiedMax - center));
+			const i32 first_ring = std::max({ gap.x, gap.y, gap.z });
+			const i32 last_ring = std::max({ reach.x, reach.y, reach.z });
+
+			for (i32 ring = first_ring; ring <= last_ring; ring++)
+			{
+				ForEachCellInRing(center, ring, [&](const std::vector<u32>& cell)
+					{
+						for (const u32 entity : cell)
+						{
+							if (!Visit(entity))
+								continue;
+
+							const f32 distance = DistanceSquared(mEntries[entity].Bounds, point);
+							if (mNearest.size() < count)
+							{
+								mNearest.emplace_back(distance, entity);
+								std::ranges::push_heap(mNearest, closer);
+							}
+							else if (distance < mNearest.front().first)
+							{
+								std::ranges::pop_heap(mNearest, closer);
+								mNearest.back() = { distance, entity };
+								std::ranges::push_heap(mNearest, closer);
+							}
+						}
+					});
+
+				// Every entity closer than ring cells has been seen
+				const f32 searched = ring * mCellSize;
+				if (mNearest.size() == count && mNearest.front().first <= searched * searched)
+					break;
+			}
+
+			std::ranges::sort_heap(mNearest, closer);
+			for (const u32 entity : mNearest | std::views::values)
+				mResult.push_back(entity);
+			return mResult;
+		}
+
+	private:
+		struct Entry
+		{
+			AABB Bounds{};
+			glm::ivec3 MinCell{};
+			glm::ivec3 MaxCell{};
+			bool Present = false;
+		};
+
+		[[nodiscard]] glm::ivec3 CellOf(const glm::vec3& position) const
+		{
+			return glm::ivec3(glm::floor(position * mInvCellSize));
+		}
+
+		// 21 bits per axis
+		[[nodiscard]] static u64 CellKey(const glm::ivec3& cell)
+		{
+			constexpr u64 mask = (1ull << 21) - 1;
+			return ((u64)cell.x & mask) << 42 | ((u64)cell.y & mask) << 21 | ((u64)cell.z & mask);
+		}
+
+		[[nodiscard]] static bool Overlaps(const AABB& l, const AABB& r)
+		{
+			return glm::all(glm::lessThanEqual(l.Min, r.Max)) && glm::all(glm::lessThanEqual(r.Min, l.Max));
+		}
+
+		[[nodiscard]] static f32 DistanceSquared(const AABB& bounds, const glm::vec3& point)
+		{
+			const glm::vec3 delta = point - glm::clamp(point, bounds.Min, bounds.Max);
+			return glm::dot(delta, delta);
+		}
+
+		void AddToCells(u32 entity, const Entry& entry)
+		{
+			for (i32 x = entry.MinCell.x; x <= entry.MaxCell.x; x++)
+				for (i32 y = entry.MinCell.y; y <= entry.MaxCell.y; y++)
+					for (i32 z = entry.MinCell.z; z <= entry.MaxCell.z; z++)
+						mCells[CellKey({ x, y, z })].push_back(entity);
+
+			if (mCount == 0)
+			{
+				mOccupiedMin = entry.MinCell;
+				mOccupiedMax = entry.MaxCell;
+			}
+			mOccupiedMin = glm::min(mOccupiedMin, entry.MinCell);
+			mOccupiedMax = glm::max(mOccupiedMax, entry.MaxCell);
+		}
+
+		void RemoveFromCells(u32 entity, const Entry& entry)
+		{
+			for (i32 x = entry.MinCell.x; x <= entry.MaxCell.x; x++)
+				for (i32 y = entry.MinCell.y; y <= entry.MaxCell.y; y++)
+					for (i32 z = entry.MinCell.z; z <= entry.MaxCell.z; z++)
+					{
+						const auto it = mCells.find(CellKey({ x, y, z }));
+						std::vector<u32>& cell = it->second;
+						*std::ranges::find(cell, entity) = cell.back();
+						cell.pop_back();
+						if (!cell.empty())
+							continue;
+
+						mCells.erase(it);
+						// The occupied range may shrink, worked out again by the next query
+						if (x == mOccupiedMin.x || x == mOccupiedMax.x || y == mOccupiedMin.y || y == mOccupiedMax.y || z == mOccupiedMin.z || z == mOccupiedMax.z)
+							mOccupiedStale = true;
+					}
+		}
+
+		// Entities that passed far away would keep the query loops scanning empty cells otherwise
+		void ShrinkOccupied()
+		{
+			mOccupiedStale = false;
+			bool first = true;
+			for (const Entry& entry : mEntries)
+			{
+				if (!entry.Present)
+					continue;
+
+				mOccupiedMin = first ? entry.MinCell : glm::min(mOccupiedMin, entry.MinCell);
+				mOccupiedMax = first ? entry.MaxCell : glm::max(mOccupiedMax, entry.MaxCell);
+				first = false;
+			}
+		}
+
+		// Only the occupied part of the grid is walked
+		template<typename F>
+		void ForEachCell(glm::ivec3 min_cell, glm::ivec3 max_cell, F&& function) const
+		{
+			if (mCount == 0)
+				return;
+
+			min_cell = glm::max(min_cell, mOccupiedMin);
+			max_cell = glm::min(max_cell, mOccupiedMax);
+			for (i32 x = min_cell.x; x <= max_cell.x; x++)
+				for (i32 y = min_cell.y; y <= max_cell.y; y++)
+					for (i32 z = min_cell.z; z <= max_cell.z; z++)
+					{
+						const auto it = mCells.find(CellKey({ x, y, z }));
+						if (it != mCells.end())
+							function(it->second);
+					}
+		}
+
+		// Occupied cells at exactly ring steps from center
+		template<typename F>
+		void ForEachCellInRing(const glm::ivec3& center, i32 ring, F&& function) const
+		{
+			const auto visit = [&](i32 x, i32 y, i32 z)
+				{
+					const auto it = mCells.find(CellKey({ x, y, z }));
+					if (it != mCells.end())
+						function(it->second);
+				};
+
+			const glm::ivec3 low = glm::max(center - ring, mOccupiedMin);
+			const glm::ivec3 high = glm::min(center + ring, mOccupiedMax);
+			for (i32 x = low.x; x <= high.x; x++)
+				for (i32 y = low.y; y <= high.y; y++)
+				{
+					if (std::abs(x - center.x) == ring || std::abs(y - center.y) == ring)
+					{
+						for (i32 z = low.z; z <= high.z; z++)
+							visit(x, y, z);
+						continue;
+					}
+
+					// Inside the shell only the two z faces are on the ring
+					if (center.z - ring >= low.z)
+						visit(x, y, center.z - ring);
+					if (center.z + ring <= high.z)
+						visit(x, y, center.z + ring);
+				}
+		}
+
+		void BeginQuery()
+		{
+			mResult.clear();
+			if (mOccupiedStale)
+				ShrinkOccupied();
+			// Stamps wrapped around, old marks could look current
+			if (++mStamp == 0)
+			{
+				std::ranges::fill(mVisited, 0);
+				mStamp = 1;
+			}
+		}
+
+		// False if entity was already seen in this query, entities can be in several cells
+		bool Visit(u32 entity)
+		{
+			if (mVisited[entity] == mStamp)
+				return false;
+			mVisited[entity] = mStamp;
+			return true;
+		}
+
+	private:
+		f32 mCellSize;
+		f32 mInvCellSize;
+
+		std::unordered_map<u64, std::vector<u32>> mCells;
+		// Indexed by entity index
+		std::vector<Entry> mEntries;
+		usize mCount = 0;
+
+		// Cell range that holds entities, bounds the query loops
+		glm::ivec3 mOccupiedMin{};
+		glm::ivec3 mOccupiedMax{};
+		// Set when a cell on the border of the range emptied
+		bool mOccupiedStale = false;
+
+		std::vector<u32> mVisited;
+		u32 mStamp = 0;
+		std::vector<u32> mResult;
+		std::vector<std::pair<f32, u32>> mNearest;
+	};
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "SpatialIndex.h"
+#include "Testing.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Steve;
+
+namespace
+{
+	f32 DistanceSquared(const AABB& bounds, const glm::vec3& point)
+	{
+		const glm::vec3 delta = point - glm::clamp(point, bounds.Min, bounds.Max);
+		return glm::dot(delta, delta);
+	}
+
+	// Distances of the count closest boxes, ascending
+	std::vector<f32> BruteForce(const std::vector<AABB>& boxes, const std::vector<bool>& present, const glm::vec3& point, usize count)
+	{
+		std::vector<f32> distances;
+		for (usize i = 0; i < boxes.size(); i++)
+		{
+			if (present[i])
+				distances.push_back(DistanceSquared(boxes[i], point));
+		}
+		std::ranges::sort(distances);
+		distances.resize(std::min(count, distances.size()));
+		return distances;
+	}
+
+	void CheckNearest(SpatialGrid& grid, const std::vector<AABB>& boxes, const std::vector<bool>& present, const glm::vec3& point, usize count)
+	{
+		const std::vector<f32> expected = BruteForce(boxes, present, point, count);
+		const std::span<const u32> result = grid.QueryNearest(point, count);
+		CHECK(result.size() == expected.size());
+		for (usize i = 0; i < std::min(result.size(), expected.size()); i++)
+		{
+			CHECK(present[result[i]]);
+			CHECK(DistanceSquared(boxes[result[i]], point) == expected[i]);
+		}
+	}
+
+	void EmptyGrid()
+	{
+		SpatialGrid grid(1.0f);
+		CHECK(grid.QueryNearest(glm::vec3(0.0f), 4).empty());
+
+		grid.Insert(0, { glm::vec3(0.0f), glm::vec3(1.0f) });
+		CHECK(grid.QueryNearest(glm::vec3(0.0f), 0).empty());
+		grid.Remove(0);
+		CHECK(grid.QueryNearest(glm::vec3(0.0f), 4).empty());
+	}
+
+	// Points inside, next to and far outside the occupied cells, asking for fewer, as many and more than there are
+	void MatchesBruteForce()
+	{
+		std::mt19937 random(42);
+		std::uniform_real_distribution<f32> position(-50.0f, 50.0f);
+		std::uniform_real_distribution<f32> extent(0.0f, 6.0f);
+
+		SpatialGrid grid(4.0f);
+		std::vector<AABB> boxes;
+		std::vector<bool> present;
+		for (u32 i = 0; i < 500; i++)
+		{
+			const glm::vec3 min(position(random), position(random), position(random));
+			const AABB box{ min, min + glm::vec3(extent(random), extent(random), extent(random)) };
+			boxes.push_back(box);
+			present.push_back(true);
+			grid.Insert(i, box);
+		}
+
+		// Removed entities must not come back
+		for (u32 i = 0; i < 500; i += 7)
+		{
+			grid.Remove(i);
+			present[i] = false;
+		}
+
+		const std::vector<glm::vec3> points = {
+			glm::vec3(0.0f), glm::vec3(49.0f, -49.0f, 10.0f), glm::vec3(60.0f, 0.0f, 0.0f),
+			glm::vec3(-1000.0f, 2000.0f, 5.0f), glm::vec3(1.0e5f, 1.0e5f, 1.0e5f)
+		};
+		for (const glm::vec3& point : points)
+		{
+			for (const usize count : { 1, 8, 100, 428, 1000 })
+				CheckNearest(grid, boxes, present, point, count);
+		}
+	}
+
+	// One far away entity, the search has to walk out to its ring and stop there
+	void SingleDistantEntity()
+	{
+		SpatialGrid grid(1.0f);
+		grid.Insert(3, { glm::vec3(300.0f, -20.0f, 7.0f), glm::vec3(301.0f, -19.0f, 8.0f) });
+
+		const std::span<const u32> result = grid.QueryNearest(glm::vec3(0.0f), 5);
+		CHECK(result.size() == 1);
+		CHECK(!result.empty() && result[0] == 3);
+	}
+
+	// The occupied range shrinks back after an entity passed far away, every entity is still found
+	void EntityPassesFarAway()
+	{
+		SpatialGrid grid(1.0f);
+		std::vector<AABB> boxes;
+		std::vector<bool> present;
+		for (u32 i = 0; i < 100; i++)
+		{
+			const glm::vec3 min((f32)(i % 10) - 5.0f, (f32)(i / 10) - 5.0f, 0.5f);
+			boxes.push_back({ min, min + glm::vec3(0.5f) });
+			present.push_back(true);
+			grid.Insert(i, boxes.back());
+		}
+
+		const AABB home = boxes[0];
+		boxes[0] = { glm::vec3(60.0f), glm::vec3(61.0f) };
+		grid.Update(0, boxes[0]);
+		CheckNearest(grid, boxes, present, glm::vec3(0.0f), 100);
+
+		boxes[0] = home;
+		grid.Update(0, boxes[0]);
+		CheckNearest(grid, boxes, present, glm::vec3(0.0f), 100);
+		CheckNearest(grid, boxes, present, glm::vec3(60.0f), 1);
+		CHECK(grid.QueryAABB({ glm::vec3(-1.0e4f), glm::vec3(1.0e4f) }).size() == 100);
+
+		grid.Remove(99);
+		present[99] = false;
+		CheckNearest(grid, boxes, present, glm::vec3(4.0f, 4.0f, 0.0f), 3);
+		CHECK(grid.QuerySphere(glm::vec3(0.0f), 100.0f).size() == 99);
+	}
+}
+
+int main()
+{
+	EmptyGrid();
+	MatchesBruteForce();
+	SingleDistantEntity();
+	EntityPassesFarAway();
+	return Steve::Testing::Result();
+}
@@ -0,0 +1,142 @@
+#ifndef STAGING_HEADER_
+#define STAGING_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/UUID.h"
+
+#include "ComponentInfo.h"
+#include "EntityAllocator.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace Steve
+{
+	// Per thread pool for new entities and components, a worker thread only touches its own buffer
+	// Registry::MergeStaging moves everything into the registry at a sync point
+	class StagingBuffer
+	{
+		friend class Registry;
+
+	public:
+		StagingBuffer(EntityAllocator* allocator) : mAllocator(allocator) {}
+		StagingBuffer(const StagingBuffer&) = delete;
+		~StagingBuffer() { DestroyComponents(); }
+
+		// The id can be used right away, the entity exists in the registry after the merge
+		UUID CreateEntity()
+		{
+			return mEntities.emplace_back(mAllocator->Reserve()).Id;
+		}
+
+		// entity can be staged in any buffer or already be in the registry, it is resolved during the merge
+		template<typename T>
+		void AddComponent(const UUID& entity, T&& component)
+		{
+			using Type = std::remove_cvref_t<T>;
+			u8* data = nullptr;
+			if constexpr (!TagComponent<Type>)
+			{
+				// Staged components never move until the merge, so any type can be staged
+				data = Allocate(sizeof(Type), alignof(Type));
+				new(data) Type(std::forward<T>(component));
+			}
+			mComponents.push_back({ entity, &GetComponentTypeInfo<Type>(), data });
+		}
+
+		[[nodiscard]] bool IsEmpty() const { return mEntities.empty() && mComponents.empty(); }
+
+	private:
+		struct StagedEntity
+		{
+			StagedEntity(u32 index) : Index(index) {}
+
+			u32 Index;
+			UUID Id;
+		};
+
+		struct StagedComponent
+		{
+			UUID Entity;
+			const ComponentTypeInfo* Info;
+			u8* Data; // nullptr for tags
+		};
+
+		struct AlignedDelete
+		{
+			std::align_val_t Alignment;
+			void operator()(u8* data) const { ::operator delete(data, Alignment); }
+		};
+
+		// Fixed block of memory, chunks are added but never resized
+		struct Chunk
+		{
+			Chunk(usize size, usize alignment)
+				: Data(static_cast<u8*>(::operator new(size, std::align_val_t(alignment))), AlignedDelete{ std::align_val_t(alignment) }),
+				  Size(size), Alignment(alignment) {}
+
+			std::unique_ptr<u8, AlignedDelete> Data;
+			usize Size;
+			usize Alignment;
+		};
+
+		static constexpr usize ChunkSize = 16 * 1024;
+		static constexpr usize ChunkAlignment = 64;
+
+		// Bump allocates from the chunks, chunks of earlier merges are reused
+		u8* Allocate(usize size, usize alignment)
+		{
+			for (; mChunk < mChunks.size(); mChunk++, mChunkUsed = 0)
+			{
+				const Chunk& chunk = mChunks[mChunk];
+				const usize offset = (mChunkUsed + alignment - 1) & ~(alignment - 1);
+				if (alignment <= chunk.Alignment && offset + size <= chunk.Size)
+				{
+					mChunkUsed = offset + size;
+					return chunk.Data.get() + offset;
+				}
+			}
+
+			// Components bigger than a chunk get a chunk of their own
+			// New chunks keep the biggest alignment seen, so mixed over-aligned types do not skip chunks
+			const usize chunk_alignment = std::max({ alignment, ChunkAlignment, mChunks.empty() ? 0 : mChunks.back().Alignment });
+			const Chunk& chunk = mChunks.emplace_back(std::max(size, ChunkSize), chunk_alignment);
+			mChunkUsed = size;
+			return chunk.Data.get();
+		}
+
+		void DestroyComponents()
+		{
+			for (const StagedComponent& component : mComponents)
+			{
+				if (!component.Info->Tag && component.Info->Destroy != nullptr)
+					component.Info->Destroy(component.Data);
+			}
+			Clear();
+		}
+
+		// After a merge, the components have already been moved out and destroyed
+		void Clear()
+		{
+			mEntities.clear();
+			mComponents.clear();
+			mChunk = 0;
+			mChunkUsed = 0;
+		}
+
+	private:
+		EntityAllocator* mAllocator;
+
+		std::vector<StagedEntity> mEntities;
+		std::vector<StagedComponent> mComponents;
+
+		std::vector<Chunk> mChunks;
+		usize mChunk = 0;
+		usize mChunkUsed = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,268 @@
+#include "Streaming.h"
+
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/Profiling.h"
+
+#include <fstream>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace Steve
+{
+
+	MappedFile::MappedFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			mFile = nullptr;
+			return;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+			return;
+
+		mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping == nullptr)
+			return;
+
+		mData = (const u8*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		mSize = mData != nullptr ? (usize)size.QuadPart : 0;
+#else
+		const int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat status;
+		if (fstat(file, &status) == 0 && status.st_size > 0)
+		{
+			void* data = mmap(nullptr, (usize)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED)
+			{
+				mData = (const u8*)data;
+				mSize = (usize)status.st_size;
+			}
+		}
+		// The mapping keeps the file alive
+		close(file);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+#ifdef _WIN32
+		if (mData != nullptr)
+			UnmapViewOfFile(mData);
+		if (mMapping != nullptr)
+			CloseHandle(mMapping);
+		if (mFile != nullptr)
+			CloseHandle(mFile);
+#else
+		if (mData != nullptr)
+			munmap((void*)mData, mSize);
+#endif
+	}
+
+	WorldPartition::WorldPartition(std::filesystem::path directory, const usize memory_budget)
+		: mDirectory(std::move(directory)), mMemoryBudget(memory_budget),
+		mThread([this](std::stop_token stop) { Run(stop); })
+	{
+	}
+
+	void WorldPartition::Assign(const u32 entity, const CellId cell, const usize bytes)
+	{
+		CORE_ASSERT(GetState(cell) == CellState::Resident, "Entities can only be added to resident cells")
+		Unassign(entity);
+		if (entity >= mMemberships.size())
+			mMemberships.resize(entity + 1);
+
+		Cell& target = mCells[cell];
+		mMemberships[entity] = { cell, (u32)target.Entities.size(), bytes };
+		target.Entities.push_back(entity);
+		target.Bytes += bytes;
+		mResidentBytes += bytes;
+	}
+
+	void WorldPartition::Unassign(const u32 entity)
+	{
+		if (entity >= mMemberships.size() || mMemberships[entity].Slot == InvalidIndex)
+			return;
+
+		Membership& membership = mMemberships[entity];
+		Cell& cell = mCells.at(membership.Cell);
+
+		// Swap remove, the moved entity takes over the slot
+		const u32 last = cell.Entities.back();
+		cell.Entities[membership.Slot] = last;
+		mMemberships[last].Slot = membership.Slot;
+		cell.Entities.pop_back();
+
+		cell.Bytes -= membership.Bytes;
+		mResidentBytes -= membership.Bytes;
+		membership = {};
+	}
+
+	void WorldPartition::ComponentChanged(const u32 entity, const usize size, const bool added)
+	{
+		if (entity >= mMemberships.size() || mMemberships[entity].Slot == InvalidIndex)
+			return;
+
+		Membership& membership = mMemberships[entity];
+		Cell& cell = mCells.at(membership.Cell);
+		if (added)
+		{
+			membership.Bytes += size;
+			cell.Bytes += size;
+			mResidentBytes += size;
+		}
+		else
+		{
+			membership.Bytes -= size;
+			cell.Bytes -= size;
+			mResidentBytes -= size;
+		}
+	}
+
+	std::optional<CellId> WorldPartition::GetCell(const u32 entity) const
+	{
+		if (entity >= mMemberships.size() || mMemberships[entity].Slot == InvalidIndex)
+			return {};
+		return mMemberships[entity].Cell;
+	}
+
+	// Cells that were never seen are resident and empty
+	CellState WorldPartition::GetState(const CellId cell) const
+	{
+		const auto it = mCells.find(cell);
+		return it != mCells.end() ? it->second.State : CellState::Resident;
+	}
+
+	std::span<const u32> WorldPartition::GetEntities(const CellId cell) const
+	{
+		const auto it = mCells.find(cell);
+		return it != mCells.end() ? std::span<const u32>(it->second.Entities) : std::span<const u32>();
+	}
+
+	void WorldPartition::Touch(const CellId cell)
+	{
+		mCells[cell].LastUsed = mFrame;
+	}
+
+	std::optional<CellId> WorldPartition::FindEvictionCandidate() const
+	{
+		std::optional<CellId> candidate;
+		u64 oldest = mFrame;
+		for (const auto& [id, cell] : mCells)
+		{
+			if (cell.State == CellState::Resident && cell.Bytes > 0 && cell.LastUsed < oldest)
+			{
+				candidate = id;
+				oldest = cell.LastUsed;
+			}
+		}
+		return candidate;
+	}
+
+	void WorldPartition::QueueSave(const CellId cell, std::vector<u8>&& chunk)
+	{
+		mCells[cell].State = CellState::Saving;
+		{
+			std::scoped_lock lock(mMutex);
+			mJobs.push_back({ cell, std::move(chunk), false });
+		}
+		mWake.notify_one();
+	}
+
+	// Jobs run in order, so a load queued behind the save of the same cell reads the new file
+	void WorldPartition::QueueLoad(const CellId cell)
+	{
+		mCells[cell].State = CellState::Loading;
+		{
+			std::scoped_lock lock(mMutex);
+			mJobs.push_back({ cell, {}, true });
+		}
+		mWake.notify_one();
+	}
+
+	std::vector<WorldPartition::Completion> WorldPartition::TakeCompletions()
+	{
+		std::scoped_lock lock(mMutex);
+		return std::exchange(mCompletions, {});
+	}
+
+	std::filesystem::path WorldPartition::GetChunkPath(const CellId cell) const
+	{
+		return mDirectory / ("cell_" + std::to_string(cell) + ".chunk");
+	}
+
+	/**
+	 * \brief I/O thread. Writes chunks of evicted cells and maps the chunks of
+	 * requested ones. After a stop request the remaining jobs are still done, so
+	 * no evicted cell is lost
+	 */
+	void WorldPartition::Run(const std::stop_token stop)
+	{
+		std::unique_lock lock(mMutex);
+		while (true)
+		{
+			mWake.wait(lock, stop, [&] { return !mJobs.empty(); });
+			if (mJobs.empty())
+				return;
+
+			Job job = std::move(mJobs.front());
+			mJobs.pop_front();
+			lock.unlock();
+
+			const std::filesystem::path path = GetChunkPath(job.Cell);
+			Completion completion{ job.Cell, job.Load, true, nullptr, {} };
+			if (job.Load)
+			{
+				completion.File = std::make_unique<MappedFile>(path);
+				completion.Ok = completion.File->IsOpen();
+				if (!completion.Ok)
+				{
+					CORE_ERROR("Could not map chunk file {}", path.string());
+				}
+				else
+				{
+					// Faults the pages in here, so restoring on the main thread does not wait on the disk
+					volatile u8 sink = 0;
+					for (usize offset = 0; offset < completion.File->GetSize(); offset += 4096)
+						sink = sink + completion.File->GetData()[offset];
+				}
+			}
+			else
+			{
+				std::ofstream file(path, std::ios::binary | std::ios::trunc);
+				file.write((const char*)job.Chunk.data(), (std::streamsize)job.Chunk.size());
+				file.close();
+				completion.Ok = !file.fail();
+				if (!completion.Ok)
+				{
+					// A partial file must not be loaded later, the chunk goes back to the registry instead
+					CORE_ERROR("Could not write chunk file {}", path.string());
+					std::error_code error;
+					std::filesystem::remove(path, error);
+					completion.Chunk = std::move(job.Chunk);
+				}
+			}
+
+			lock.lock();
+			mCompletions.push_back(std::move(completion));
+		}
+	}
+
+}
@@ -0,0 +1,193 @@
+#ifndef STREAMING_HEADER_
+#define STREAMING_HEADER_
+
+#include "Steve/Core/Core.h"
+#include "Steve/Core/UUID.h"
+
+#include "ComponentInfo.h"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Steve
+{
+	// Partition of the world, entities of one cell are evicted and restored together
+	using CellId = u64;
+
+	enum class CellState : u8
+	{
+		Resident,
+		// Entities are gone, the chunk file is being written
+		Saving,
+		Evicted,
+		// Chunk file is being read, the entities come back at the next Registry::UpdateStreaming
+		Loading
+	};
+
+	// Chunk file: header, one record per entity, then one column per component type
+	// A column holds the entity slot of every component followed by the components packed back to back like in the pools,
+	// so writing and restoring a cell is a copy per component and never serializes an entity
+	// Type ids are only stable within one run, chunk files are a cache and not a save format
+	constexpr u32 ChunkMagic = 0x4B4E4843; // "CHNK"
+	constexpr u32 ChunkVersion = 1;
+
+	struct ChunkHeader
+	{
+		u32 Magic;
+		u32 Version;
+		CellId Cell;
+		u32 EntityCount;
+		u32 ColumnCount;
+	};
+
+	// Written with its padding zeroed, so no uninitialized bytes end up in the file
+	struct ChunkEntity
+	{
+		UUID Id;
+		// Only valid if HasParent is set
+		UUID Parent;
+		// Signature, tags are only stored here
+		u64 Types;
+		u32 HasParent;
+	};
+
+	struct ChunkColumn
+	{
+		ComponentId Type;
+		u32 Size;
+		u32 Count;
+		// From the start of the file
+		u64 SlotOffset;
+		u64 DataOffset;
+	};
+
+	[[nodiscard]] constexpr u64 AlignChunkOffset(u64 offset) { return (offset + 15) & ~15ull; }
+
+	// Read only mapping of a whole file
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::filesystem::path& path);
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		[[nodiscard]] bool IsOpen() const { return mData != nullptr; }
+		[[nodiscard]] const u8* GetData() const { return mData; }
+		[[nodiscard]] usize GetSize() const { return mSize; }
+
+	private:
+		const u8* mData = nullptr;
+		usize mSize = 0;
+#ifdef _WIN32
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#endif
+	};
+
+	// Cell membership, memory accounting and the background I/O thread of the Registry streaming, see Registry::EnableStreaming
+	// Only the I/O thread touches the disk, everything else is called from the main thread
+	class WorldPartition
+	{
+	public:
+		struct Cell
+		{
+			// Entity indices, unordered
+			std::vector<u32> Entities;
+			CellState State = CellState::Resident;
+			// Component bytes of the entities
+			usize Bytes = 0;
+			// Frame of the last RequestCell, the least recently used cell is evicted first
+			u64 LastUsed = 0;
+		};
+
+		// Finished I/O, handed to the registry at its sync point
+		struct Completion
+		{
+			CellId Cell;
+			bool Load;
+			// False if the chunk file could not be mapped or written
+			bool Ok;
+			// Mapped chunk of a load
+			std::unique_ptr<MappedFile> File;
+			// Chunk of a failed save, the registry restores the cell from it
+			std::vector<u8> Chunk;
+		};
+
+		WorldPartition(std::filesystem::path directory, usize memory_budget);
+		WorldPartition(const WorldPartition&) = delete;
+		// Finishes the queued saves before the thread exits
+		~WorldPartition() = default;
+
+		// bytes is the size of the components the entity already has
+		void Assign(u32 entity, CellId cell, usize bytes);
+		void Unassign(u32 entity);
+		// Keeps the byte count of the entity's cell up to date, called on every signature change
+		void ComponentChanged(u32 entity, usize size, bool added);
+
+		[[nodiscard]] std::optional<CellId> GetCell(u32 entity) const;
+		[[nodiscard]] CellState GetState(CellId cell) const;
+		[[nodiscard]] std::span<const u32> GetEntities(CellId cell) const;
+		[[nodiscard]] usize GetResidentBytes() const { return mResidentBytes; }
+		[[nodiscard]] bool IsOverBudget() const { return mResidentBytes > mMemoryBudget; }
+
+		void Touch(CellId cell);
+		void AdvanceFrame() { mFrame++; }
+		// Resident cell that was used longest ago and not this frame
+		[[nodiscard]] std::optional<CellId> FindEvictionCandidate() const;
+
+		void QueueSave(CellId cell, std::vector<u8>&& chunk);
+		void QueueLoad(CellId cell);
+		void SetState(CellId cell, CellState state) { mCells[cell].State = state; }
+		[[nodiscard]] std::vector<Completion> TakeCompletions();
+
+	private:
+		struct Job
+		{
+			CellId Cell;
+			// Empty for loads
+			std::vector<u8> Chunk;
+			bool Load;
+		};
+
+		struct Membership
+		{
+			CellId Cell = 0;
+			// Position in Cell::Entities
+			u32 Slot = InvalidIndex;
+			usize Bytes = 0;
+		};
+
+		[[nodiscard]] std::filesystem::path GetChunkPath(CellId cell) const;
+		void Run(std::stop_token stop);
+
+	private:
+		std::filesystem::path mDirectory;
+		usize mMemoryBudget;
+		usize mResidentBytes = 0;
+		u64 mFrame = 1;
+
+		std::unordered_map<CellId, Cell> mCells;
+		// Indexed by entity index, Slot is InvalidIndex if the entity is in no cell
+		std::vector<Membership> mMemberships;
+
+		std::mutex mMutex;
+		std::condition_variable_any mWake;
+		std::deque<Job> mJobs;
+		std::vector<Completion> mCompletions;
+
+		// Last, so it is joined before the queues are destroyed
+		std::jthread mThread;
+	};
+}
+
+#endif
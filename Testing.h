@@ -0,0 +1,37 @@
+#ifndef TESTING_HEADER_
+#define TESTING_HEADER_
+
+#include <cstdio>
+
+// Minimal checks for the standalone *Tests.cpp executables next to the headers they cover
+// A failed check is printed and counted, the run goes on so every broken check shows up
+namespace Steve::Testing
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	// Exit code of a test executable
+	[[nodiscard]] inline int Result()
+	{
+		if (Failures() == 0)
+			std::printf("All checks passed\n");
+		else
+			std::printf("%d checks failed\n", Failures());
+		return Failures() == 0 ? 0 : 1;
+	}
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			Steve::Testing::Failures()++; \
+		} \
+	} while (false)
+
+#endif
@@ -0,0 +1,343 @@
+#include "Trace.h"
+
+#include "Steve/Core/Logger.h"
+#include "Steve/Core/Profiling.h"
+
+#include "Entity.h"
+#include "Registry.h"
+#include "Streaming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <typeindex>
+
+namespace Steve
+{
+
+	constexpr usize TraceBlockSize = 64 * 1024;
+
+	/**
+	 * \brief Stand-in for a recorded type, registered once per process and
+	 * reused by every replay. Component ids are never given back, so
+	 * registering new ones per replay would run out of them
+	 * \param occurrence Which of the stand-ins with this size and tag
+	 */
+	static const ComponentTypeInfo& GetStandInType(const usize size, const bool tag, const usize occurrence)
+	{
+		static std::mutex mutex;
+		static std::map<std::tuple<usize, bool, usize>, std::unique_ptr<ComponentTypeInfo>> types;
+
+		std::scoped_lock lock(mutex);
+		std::unique_ptr<ComponentTypeInfo>& type = types[{ size, tag, occurrence }];
+		if (type == nullptr)
+		{
+			// Plain zeroed bytes, the registry never constructs or copies components during a replay
+			type = std::make_unique<ComponentTypeInfo>(ComponentTypeInfo{
+				std::type_index(typeid(TraceReplayer)), NextComponentId(), size, true, tag,
+				nullptr, nullptr, nullptr, nullptr, nullptr, nullptr });
+			ComponentTypeTable()[type->Index] = type.get();
+		}
+		return *type;
+	}
+
+	TraceRecorder::TraceRecorder(const std::filesystem::path& path) : mFile(path, std::ios::binary | std::ios::trunc)
+	{
+		mBuffer.reserve(TraceBlockSize * 2);
+		for (const u32 word : { TraceMagic, TraceVersion })
+		{
+			for (u32 byte = 0; byte < 4; byte++)
+				mBuffer.push_back((u8)(word >> (byte * 8)));
+		}
+	}
+
+	TraceRecorder::~TraceRecorder()
+	{
+		WriteBuffer();
+	}
+
+	void TraceRecorder::CreateEntity(const u32 entity)
+	{
+		WriteOp(TraceOp::CreateEntity);
+		WriteVarint(entity);
+		EndEvent();
+	}
+
+	// Sorted, so the gaps are small and mostly fit in one byte
+	void TraceRecorder::DestroyEntities(const std::span<const u32> entities)
+	{
+		WriteOp(TraceOp::DestroyEntities);
+		WriteVarint(entities.size());
+		u32 previous = 0;
+		for (const u32 entity : entities)
+		{
+			WriteVarint(entity - previous);
+			previous = entity;
+		}
+		EndEvent();
+	}
+
+	void TraceRecorder::ComponentsChanged(const u32 entity, const Signature& types, const bool added)
+	{
+		DefineTypes(types);
+		WriteOp(added ? TraceOp::AddComponents : TraceOp::RemoveComponents);
+		WriteVarint(entity);
+		WriteVarint(types.to_ullong());
+		EndEvent();
+	}
+
+	void TraceRecorder::View(const QueryMasks& masks)
+	{
+		DefineTypes(masks.Include | masks.Exclude | masks.AnyOf);
+		WriteOp(TraceOp::View);
+		WriteVarint(masks.Include.to_ullong());
+		WriteVarint(masks.Exclude.to_ullong());
+		WriteVarint(masks.AnyOf.to_ullong());
+		EndEvent();
+	}
+
+	void TraceRecorder::DefineTypes(const Signature& types)
+	{
+		const Signature undefined = types & ~mDefined;
+		if (undefined.none())
+			return;
+
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if (!undefined.test(id))
+				continue;
+
+			const ComponentTypeInfo& info = *ComponentTypeTable()[id];
+			WriteOp(TraceOp::DefineType);
+			WriteVarint(id);
+			WriteVarint(info.Size);
+			WriteVarint(info.Tag ? 1 : 0);
+		}
+		mDefined |= undefined;
+	}
+
+	void TraceRecorder::WriteVarint(u64 value)
+	{
+		while (value >= 0x80)
+		{
+			mBuffer.push_back((u8)(value | 0x80));
+			value >>= 7;
+		}
+		mBuffer.push_back((u8)value);
+	}
+
+	void TraceRecorder::EndEvent()
+	{
+		if (mBuffer.size() >= TraceBlockSize)
+			WriteBuffer();
+	}
+
+	void TraceRecorder::WriteBuffer()
+	{
+		mFile.write((const char*)mBuffer.data(), (std::streamsize)mBuffer.size());
+		mBuffer.clear();
+	}
+
+	TraceReplayer::TraceReplayer(const std::filesystem::path& path) : mFile(std::make_unique<MappedFile>(path))
+	{
+		if (!mFile->IsOpen() || mFile->GetSize() < 8)
+			return;
+
+		u32 magic;
+		u32 version;
+		memcpy_s(&magic, sizeof(u32), mFile->GetData(), sizeof(u32));
+		memcpy_s(&version, sizeof(u32), mFile->GetData() + 4, sizeof(u32));
+		if (magic == TraceMagic && version == TraceVersion)
+			mEnd = mFile->GetData() + mFile->GetSize();
+	}
+
+	TraceReplayer::~TraceReplayer() = default;
+
+	bool TraceReplayer::IsOpen() const
+	{
+		return mEnd != nullptr;
+	}
+
+	/**
+	 * \brief Replays every event of the trace against a new registry. The
+	 * stand-in types are kept, so Run can be called again for more samples
+	 * \return Latency percentiles per event type and the total wall time
+	 */
+	TraceReplayer::Result TraceReplayer::Run()
+	{
+		CH_PROFILE_FUNCTION();
+		CORE_ASSERT(IsOpen(), "Not a trace file")
+		using Clock = std::chrono::steady_clock;
+
+		Result result;
+		std::array<std::vector<u64>, (usize)TraceOp::Count> timings;
+
+		mRegistry.reset(new Registry());
+		mEntities.clear();
+		mRead = mFile->GetData() + 8;
+
+		const Clock::time_point start = Clock::now();
+		while (mRead < mEnd)
+		{
+			const TraceOp op = (TraceOp)*mRead++;
+			CORE_ASSERT(op < TraceOp::Count, "Trace is corrupt")
+
+			const Clock::time_point begin = Clock::now();
+			Replay(op);
+			timings[(usize)op].push_back((u64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+		}
+		result.Duration = (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+		mRegistry.reset();
+
+		for (usize op = 0; op < timings.size(); op++)
+		{
+			std::vector<u64>& samples = timings[op];
+			if (samples.empty())
+				continue;
+
+			std::ranges::sort(samples);
+			const auto percentile = [&](usize p) { return samples[std::min(samples.size() - 1, samples.size() * p / 100)]; };
+
+			TraceStats& stats = result.Ops[op];
+			stats.Count = samples.size();
+			for (const u64 sample : samples)
+				stats.Total += sample;
+			stats.P50 = percentile(50);
+			stats.P90 = percentile(90);
+			stats.P99 = percentile(99);
+			stats.Max = samples.back();
+			result.Events += samples.size();
+		}
+
+		return result;
+	}
+
+	u64 TraceReplayer::ReadVarint()
+	{
+		u64 value = 0;
+		for (u32 shift = 0; mRead < mEnd; shift += 7)
+		{
+			const u8 byte = *mRead++;
+			value |= (u64)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				break;
+		}
+		return value;
+	}
+
+	Signature TraceReplayer::MapTypes(const u64 recorded) const
+	{
+		Signature types;
+		for (ComponentId id = 0; id < MaxComponentTypes; id++)
+		{
+			if ((recorded >> id) & 1)
+				types.set(mTypes[id]->Index);
+		}
+		return types;
+	}
+
+	void TraceReplayer::Replay(const TraceOp op)
+	{
+		RegistryData& data = mRegistry->mData;
+		switch (op)
+		{
+		case TraceOp::DefineType:
+		{
+			const ComponentId id = (ComponentId)ReadVarint();
+			const usize size = ReadVarint();
+			const bool tag = ReadVarint() != 0;
+			if (mTypes[id] != nullptr)
+				break;
+
+			// Recorded types of the same shape still need their own ids, the n-th one takes the n-th stand-in
+			usize occurrence = 0;
+			for (const ComponentTypeInfo* type : mTypes)
+				occurrence += type != nullptr && type->Size == size && type->Tag == tag;
+			mTypes[id] = &GetStandInType(size, tag, occurrence);
+			break;
+		}
+		case TraceOp::CreateEntity:
+		{
+			const u32 recorded = (u32)ReadVarint();
+			if (recorded >= mEntities.size())
+				mEntities.resize(recorded + 1, InvalidIndex);
+			mEntities[recorded] = mRegistry->EmplaceEntity().GetIndex();
+			break;
+		}
+		case TraceOp::DestroyEntities:
+		{
+			mScratch.resize(ReadVarint());
+			u32 recorded = 0;
+			for (u32& entity : mScratch)
+			{
+				recorded += (u32)ReadVarint();
+				entity = mEntities[recorded];
+			}
+			std::ranges::sort(mScratch);
+			mRegistry->DestroyEntities(mScratch);
+			break;
+		}
+		case TraceOp::AddComponents:
+		case TraceOp::RemoveComponents:
+		{
+			Entity& entity = data.Entities[mEntities[(u32)ReadVarint()]];
+			const Signature types = MapTypes(ReadVarint());
+
+			std::vector<IHandle*> handles;
+			Signature tags;
+			for (ComponentId id = 0; id < MaxComponentTypes; id++)
+			{
+				if (!types.test(id))
+					continue;
+
+				const ComponentTypeInfo& info = *ComponentTypeTable()[id];
+				if (info.Tag)
+					tags.set(id);
+				else if (op == TraceOp::RemoveComponents)
+					handles.push_back(data.ComponentIndices[id].Get(entity.GetIndex()));
+				else
+				{
+					IHandle* handle = mRegistry->AllocateComponent(info);
+					memset(handle->Component, 0, info.Size);
+					handles.push_back(handle);
+				}
+			}
+
+			if (op == TraceOp::AddComponents)
+				mRegistry->AttachComponents(&entity, handles, tags);
+			else
+				mRegistry->DetachComponents(&entity, handles, tags);
+			break;
+		}
+		case TraceOp::View:
+		{
+			QueryMasks masks;
+			masks.Include = MapTypes(ReadVarint());
+			masks.Exclude = MapTypes(ReadVarint());
+			masks.AnyOf = MapTypes(ReadVarint());
+
+			// Reads every included component, like a system iterating the view
+			mScratch.clear();
+			for (ComponentId id = 0; id < MaxComponentTypes; id++)
+			{
+				if (masks.Include.test(id) && !ComponentTypeTable()[id]->Tag)
+					mScratch.push_back(id);
+			}
+
+			const Query& query = mRegistry->GetQuery(masks);
+			for (const u32 entity : query.GetEntities())
+			{
+				for (const ComponentId id : mScratch)
+					mSink += *data.ComponentIndices[id].Get(entity)->Component;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+}
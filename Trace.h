@@ -0,0 +1,127 @@
+#ifndef TRACE_HEADER_
+#define TRACE_HEADER_
+
+#include "Steve/Core/Core.h"
+
+#include "ComponentInfo.h"
+#include "Query.h"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Steve
+{
+	class MappedFile;
+	class Registry;
+
+	// Trace file: magic and version, then a stream of events
+	// Every event is an op byte followed by LEB128 varints, entities are entity indices and type sets are signatures
+	// A type is defined by a DefineType event before the first event that uses it
+	enum class TraceOp : u8
+	{
+		// Type id, size, tag
+		DefineType,
+		// Entity
+		CreateEntity,
+		// Count, then the sorted entities as deltas
+		DestroyEntities,
+		// Entity, types
+		AddComponents,
+		// Entity, types
+		RemoveComponents,
+		// Include, exclude, any of
+		View,
+		Count
+	};
+
+	constexpr u32 TraceMagic = 0x54534345; // "ECST"
+	constexpr u32 TraceVersion = 1;
+
+	// Appends registry calls to a trace file, see Registry::StartTrace
+	// Events are buffered and written in blocks
+	class TraceRecorder
+	{
+	public:
+		explicit TraceRecorder(const std::filesystem::path& path);
+		TraceRecorder(const TraceRecorder&) = delete;
+		// Writes what is left in the buffer
+		~TraceRecorder();
+
+		[[nodiscard]] bool IsOpen() const { return mFile.is_open(); }
+
+		void CreateEntity(u32 entity);
+		void DestroyEntities(std::span<const u32> entities);
+		void ComponentsChanged(u32 entity, const Signature& types, bool added);
+		void View(const QueryMasks& masks);
+
+	private:
+		void DefineTypes(const Signature& types);
+		void WriteOp(TraceOp op) { mBuffer.push_back((u8)op); }
+		void WriteVarint(u64 value);
+		// Writes the buffer out once it holds a block
+		void EndEvent();
+		void WriteBuffer();
+
+	private:
+		std::ofstream mFile;
+		std::vector<u8> mBuffer;
+		// Types that have a DefineType event
+		Signature mDefined;
+	};
+
+	// Timings of one event type during a replay, in nanoseconds
+	struct TraceStats
+	{
+		usize Count = 0;
+		u64 Total = 0;
+		u64 P50 = 0;
+		u64 P90 = 0;
+		u64 P99 = 0;
+		u64 Max = 0;
+	};
+
+	// Replays a trace against a new registry and times every event
+	// Component types are stand-ins of the recorded size, so a trace replays without the game that recorded it
+	class TraceReplayer
+	{
+	public:
+		struct Result
+		{
+			std::array<TraceStats, (usize)TraceOp::Count> Ops;
+			usize Events = 0;
+			// Wall time of the whole replay
+			u64 Duration = 0;
+		};
+
+		explicit TraceReplayer(const std::filesystem::path& path);
+		TraceReplayer(const TraceReplayer&) = delete;
+		~TraceReplayer();
+
+		[[nodiscard]] bool IsOpen() const;
+		[[nodiscard]] Result Run();
+
+	private:
+		[[nodiscard]] u64 ReadVarint();
+		[[nodiscard]] Signature MapTypes(u64 recorded) const;
+		void Replay(TraceOp op);
+
+	private:
+		std::unique_ptr<MappedFile> mFile;
+		const u8* mRead = nullptr;
+		const u8* mEnd = nullptr;
+
+		std::unique_ptr<Registry> mRegistry;
+		// Recorded type id -> stand-in type, shared with every other replay
+		std::array<const ComponentTypeInfo*, MaxComponentTypes> mTypes = {};
+		// Recorded entity index -> entity index in the replay
+		std::vector<u32> mEntities;
+		std::vector<u32> mScratch;
+		u64 mSink = 0;
+	};
+}
+
+#endif
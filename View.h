@@ -5,41 +5,178 @@
 #include "Steve/Core/Logger.h"
 #include "Steve/Core/Profiling.h"
 
+#include "DoubleBuffered.h"
 #include "Entity.h"
 #include "Handle.h"
+#include "Query.h"
 #include "RegistryData.h"
 
+#include <span>
+#include <tuple>
+#include <type_traits>
 #include <vector>
-#include <set>
-#include <unordered_map>
 
 namespace Steve
 {
+	// Types that are not const, a view that yields them can write to their pools
 	template<typename ...Ts>
+	[[nodiscard]] Signature MakeWriteSignature()
+	{
+		Signature signature;
+		([&]()
+			{
+				if constexpr (!std::is_const_v<Ts>)
+					signature.set(GetComponentId<Ts>());
+			}(), ...);
+		return signature;
+	}
+
+	// Fetching only reads if every type is const, tags have no data so they never count as a write
+	template<typename ...Ts>
+	constexpr bool IsReadOnly = ((std::is_const_v<Ts> || TagComponent<Ts>) && ...);
+
+	// How a single View term is matched and what it yields, a bare type is Include<T>
+	template<typename T>
+	struct QueryTerm
+	{
+		static constexpr bool ReadOnly = IsReadOnly<T>;
+		static void Apply(QueryMasks& masks)
+		{
+			masks.Include.set(GetComponentId<T>());
+			masks.Write |= MakeWriteSignature<T>();
+		}
+		static HandleTuple_t<T> Fetch(Entity& entity, const RegistryData&) { return entity.GetComponents<T>(); }
+	};
+
+	template<typename ...Ts>
+	struct QueryTerm<Include<Ts...>>
+	{
+		static constexpr bool ReadOnly = IsReadOnly<Ts...>;
+		static void Apply(QueryMasks& masks)
+		{
+			masks.Include |= MakeSignature<Ts...>();
+			masks.Write |= MakeWriteSignature<Ts...>();
+		}
+		static HandleTuple_t<Ts...> Fetch(Entity& entity, const RegistryData&) { return entity.GetComponents<Ts...>(); }
+	};
+
+	template<typename ...Ts>
+	struct QueryTerm<Exclude<Ts...>>
+	{
+		static constexpr bool ReadOnly = true;
+		static void Apply(QueryMasks& masks) { masks.Exclude |= MakeSignature<Ts...>(); }
+		static std::tuple<> Fetch(Entity&, const RegistryData&) { return {}; }
+	};
+
+	template<typename ...Ts>
+	struct QueryTerm<Optional<Ts...>>
+	{
+		static_assert((!TagComponent<Ts> && ...), "Optional tags yield nothing, use Entity::Contains");
+		static constexpr bool ReadOnly = IsReadOnly<Ts...>;
+		static void Apply(QueryMasks& masks)
+		{
+			masks.Optional |= MakeSignature<Ts...>();
+			masks.Write |= MakeWriteSignature<Ts...>();
+		}
+		static std::tuple<Handle<Ts>*...> Fetch(Entity& entity, const RegistryData&) { return { entity.FindComponent<Ts>()... }; }
+	};
+
+	template<typename ...Ts>
+	struct QueryTerm<AnyOf<Ts...>>
+	{
+		static_assert((!TagComponent<Ts> && ...), "AnyOf tags yield nothing, use Exclude or Include");
+		static constexpr bool ReadOnly = IsReadOnly<Ts...>;
+		static void Apply(QueryMasks& masks)
+		{
+			masks.AnyOf |= MakeSignature<Ts...>();
+			masks.Write |= MakeWriteSignature<Ts...>();
+		}
+		static std::tuple<Handle<Ts>*...> Fetch(Entity& entity, const RegistryData&) { return { entity.FindComponent<Ts>()... }; }
+	};
+
+	// Read only, gets the front buffer of the last tick
+	template<typename T>
+	struct QueryTerm<const DoubleBuffered<T>>
+	{
+		static constexpr bool ReadOnly = true;
+		static void Apply(QueryMasks& masks) { masks.Include.set(GetComponentId<DoubleBuffered<T>>()); }
+		static std::tuple<const T&> Fetch(Entity& entity, const RegistryData& reg_data)
+		{
+			return { entity.GetComponent<const DoubleBuffered<T>>()->Front(reg_data.FrontBuffer) };
+		}
+	};
+
+	// Writer, gets the back buffer that becomes the front after Registry::SwapBuffers
+	template<typename T>
+	struct QueryTerm<DoubleBuffered<T>>
+	{
+		static constexpr bool ReadOnly = false;
+		static void Apply(QueryMasks& masks)
+		{
+			masks.Include.set(GetComponentId<DoubleBuffered<T>>());
+			masks.Write.set(GetComponentId<DoubleBuffered<T>>());
+		}
+		static std::tuple<T&> Fetch(Entity& entity, const RegistryData& reg_data)
+		{
+			return { entity.GetComponent<DoubleBuffered<T>>()->Back(reg_data.FrontBuffer) };
+		}
+	};
+
+	// Filter that accepts everything, compiles away
+	struct NoFilter
+	{
+		constexpr bool operator()(Entity*) const { return true; }
+	};
+
+	// Iterates the entities of a cached Query, so matching is only signature masks when components change
+	// Adding or removing components of the viewed types while iterating invalidates the iterators
+	template<typename ...Terms>
 	class View
 	{
 	public:
-		using EntityIterator = std::unordered_map<UUID, Entity>::iterator;
+		using EntityIterator = std::span<const u32>::iterator;
+		using TupleType = decltype(std::tuple_cat(std::declval<decltype(QueryTerm<Terms>::Fetch(std::declval<Entity&>(), std::declval<const RegistryData&>()))>()...));
+		// Fetching does not write anything, so several threads can fetch at once
+		static constexpr bool ReadOnly = (QueryTerm<Terms>::ReadOnly && ...);
 
-		struct Iterator		// ITERATOR
+		// Component ids are global, so the masks are only built once per View type
+		[[nodiscard]] static const QueryMasks& GetMasks()
+		{
+			static const QueryMasks masks = []()
+				{
+					QueryMasks result;
+					(QueryTerm<Terms>::Apply(result), ...);
+
+					// Entities marked for destruction drop out of every view right away
+					const ComponentId pending = GetComponentId<PendingDestroy>();
+					if (!result.Include.test(pending) && !result.AnyOf.test(pending))
+						result.Exclude.set(pending);
+					return result;
+				}();
+			return masks;
+		}
+
+		template<typename Filter>
+		struct BasicIterator		// ITERATOR
 		{
 			friend class View;
 
 			[[nodiscard]] Entity* GetEntity() const
 			{
-				return &p->second;
+				return &mRegData->Entities[*p];
 			}
 
 			//Gets components on the fly, so addr's are always good
-			template<typename Indices = std::make_index_sequence<sizeof...(Ts)>>
-			std::tuple<Handle<Ts>&...> operator*()
+			// Tags and excluded types are not in the tuple
+			TupleType operator*()
 			{
 				CH_PROFILE_FUNCTION();
-				return p->second.GetComponents<Ts...>();
+				Entity& entity = *GetEntity();
+				return std::tuple_cat(QueryTerm<Terms>::Fetch(entity, *mRegData)...);
 			}
-			std::tuple<Handle<Ts>&...> operator->() { return operator*(); }
+			TupleType operator->() { return operator*(); }
 
-			bool operator != (const Iterator& rhs) const {
+			bool operator != (const BasicIterator& rhs) const {
 				return p != rhs.p;
 			}
 			bool operator != (const EntityIterator& rhs) const
@@ -47,65 +184,121 @@ namespace Steve
 				return p != rhs;
 			}
 
-			Iterator& operator++()
+			BasicIterator& operator++()
 			{
 				++p;
-				while (p != mRegData->Entities.end() && !(
-															p->second.ContainsAll<Ts...>() &&
-															(!mFilter.has_value() || (*mFilter)(&p->second)))
-					) ++p;
+				SkipFiltered();
 				return *this;
 			}
 
-			Iterator operator++(int)
+			BasicIterator operator++(int)
 			{
-				Iterator tmp = *this;
+				BasicIterator tmp = *this;
 				operator++();
 				return tmp;
 			}
 
-			Iterator end()
+		// private constructor
+		private:
+			BasicIterator(RegistryData* reg_data, EntityIterator start, EntityIterator end, const Query* match, const Filter& filter = {})
+				: mRegData(reg_data), p(start), mEnd(end), mMatch(match), mFilter(filter)
 			{
-				auto ret = mRegData->Entities.end();
-				return Iterator(ret);
+				SkipFiltered();
 			}
 
-		// private constructor
-		private:
-			Iterator(RegistryData* reg_data, EntityIterator start = reg_data->Entities.begin(), std::function<bool(Entity*)>&& filter = nullptr)
-				: mRegData(reg_data), p(start), mFilter(filter) {}
+			void SkipFiltered()
+			{
+				if (mMatch != nullptr)
+				{
+					while (p != mEnd && !mMatch->Contains(*p)) ++p;
+				}
+				if constexpr (!std::is_same_v<Filter, NoFilter>)
+				{
+					while (p != mEnd && !mFilter(GetEntity()))
+					{
+						++p;
+						if (mMatch != nullptr)
+						{
+							while (p != mEnd && !mMatch->Contains(*p)) ++p;
+						}
+					}
+				}
+			}
 			
 		private:
 			RegistryData* mRegData;
 			EntityIterator p;
-			std::optional<std::function<bool(Entity*)>> mFilter;
+			EntityIterator mEnd;
+			// Only set when iterating a subset, entities outside the query are skipped
+			const Query* mMatch;
+			Filter mFilter;
 		};	// ITERATOR
 
-		View(RegistryData* reg_data)
+		using Iterator = BasicIterator<NoFilter>;
+
+		// Range returned by FilterBy, the filter is inlined instead of going through a std::function
+		template<typename Filter>
+		class FilteredView
 		{
-			mRegData = reg_data;
-			if (mTypes.empty())
-				(void(mTypes.push_back(std::type_index(typeid(Ts)))), ...);
+		public:
+			FilteredView(const View& view, Filter filter) : mView(view), mFilter(std::move(filter)) {}
+
+			BasicIterator<Filter> begin() const { return mView.template MakeIterator<Filter>(mView.Entities().begin(), mFilter); }
+			BasicIterator<Filter> end() const { return mView.template MakeIterator<Filter>(mView.Entities().end(), mFilter); }
+
+		private:
+			View mView;
+			Filter mFilter;
+		};
+
+		View(RegistryData* reg_data, const Query& query) : mRegData(reg_data), mQuery(&query) {}
+		// Only visits the entities of subset that match the terms, e.g. the result of a spatial query
+		View(RegistryData* reg_data, const Query& query, std::span<const u32> subset)
+			: mRegData(reg_data), mQuery(&query), mSubset(subset), mHasSubset(true) {}
+
+		inline Iterator begin() const
+		{
+			return MakeIterator<NoFilter>(Entities().begin());
+		}
+
+		inline Iterator end() const
+		{
+			return MakeIterator<NoFilter>(Entities().end());
 		}
 
-		inline Iterator begin()
+		// For conditions that are not expressible as terms, prefer Exclude/AnyOf where possible
+		template<typename Filter>
+		inline FilteredView<std::decay_t<Filter>> FilterBy(Filter&& filter_function) const
 		{
-			return Iterator();
+			return FilteredView<std::decay_t<Filter>>(*this, std::forward<Filter>(filter_function));
 		}
 
-		inline Iterator end()
+		// For a subset view this is the size of the subset, not all of it has to match
+		[[nodiscard]] usize GetSize() const { return mHasSubset ? mSubset.size() : mQuery->GetSize(); }
+
+		// Random access for work split over threads, entity_index has to match the terms
+		[[nodiscard]] TupleType Fetch(u32 entity_index) const
 		{
-			return Iterator(mRegData->Entities.end());
+			Entity& entity = mRegData->Entities[entity_index];
+			return std::tuple_cat(QueryTerm<Terms>::Fetch(entity, *mRegData)...);
 		}
+		[[nodiscard]] std::span<const u32> GetEntities() const { return Entities(); }
+
+	private:
+		[[nodiscard]] std::span<const u32> Entities() const { return mHasSubset ? mSubset : std::span<const u32>(mQuery->GetEntities()); }
 
-		inline Iterator FilterBy(std::function<bool(Entity*)>&& filter_function)
+		template<typename Filter>
+		BasicIterator<Filter> MakeIterator(EntityIterator start, const Filter& filter = {}) const
 		{
-			return Iterator(std::forward< std::function<bool(Entity*)> && >(filter_function));
+			return BasicIterator<Filter>(mRegData, start, Entities().end(), mHasSubset ? mQuery : nullptr, filter);
 		}
+
 	private:
-		std::vector<std::type_index> mTypes;
 		RegistryData* mRegData;
+		const Query* mQuery;
+		std::span<const u32> mSubset;
+		bool mHasSubset = false;
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+// Replays a trace written by Registry::StartTrace and prints throughput and latency percentiles per event type
+// Usage: ecs_replay <trace> [runs]
+// Builds as its own executable against the ECS sources, the component types of the game are not needed
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+
+namespace
+{
+	constexpr const char* OpNames[] = { "define type", "create", "destroy", "add", "remove", "view" };
+	static_assert(std::size(OpNames) == (size_t)Steve::TraceOp::Count, "Every trace op needs a name");
+
+	void Print(const Steve::TraceReplayer::Result& result, int run)
+	{
+		const double seconds = (double)result.Duration / 1e9;
+		printf("run %d: %zu events in %.3f ms, %.0f events/s\n", run, result.Events, seconds * 1e3, seconds > 0.0 ? (double)result.Events / seconds : 0.0);
+		printf("  %-12s %10s %12s %10s %10s %10s %10s\n", "op", "count", "total us", "p50 ns", "p90 ns", "p99 ns", "max ns");
+		for (size_t op = 0; op < result.Ops.size(); op++)
+		{
+			const Steve::TraceStats& stats = result.Ops[op];
+			if (stats.Count == 0)
+				continue;
+
+			printf("  %-12s %10zu %12.1f %10llu %10llu %10llu %10llu\n", OpNames[op], stats.Count, (double)stats.Total / 1e3,
+				(unsigned long long)stats.P50, (unsigned long long)stats.P90, (unsigned long long)stats.P99, (unsigned long long)stats.Max);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <trace> [runs]\n", argv[0]);
+		return 1;
+	}
+
+	Steve::TraceReplayer replayer(argv[1]);
+	if (!replayer.IsOpen())
+	{
+		fprintf(stderr, "%s is not a trace file\n", argv[1]);
+		return 1;
+	}
+
+	const int runs = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+	for (int run = 0; run < runs; run++)
+		Print(replayer.Run(), run);
+	return 0;
+}